@@ -1,12 +1,15 @@
 #pragma once
 
 #include "hdf5_utils.hpp"
+#include "io_trace.hpp"
 #include <H5Cpp.h>
 
 template <typename VT>
 void read_attribute(const H5::H5Object &obj, const std::string &attr_name, VT &value)
 {
   H5::Attribute attr = obj.openAttribute(attr_name);
+  hdf5_trace_scope trace(trace_op::attr_read, trace_mode::serial, obj.getId(), 0, sizeof(VT),
+                         attr_name.c_str());
   attr.read(attr.getDataType(), &value);
 }
 
@@ -14,6 +17,8 @@ template <typename VT, std::size_t N>
 void read_attribute(const H5::H5Object &obj, const std::string &attr_name, std::array<VT, N> &values)
 {
   H5::Attribute attr = obj.openAttribute(attr_name);
+  hdf5_trace_scope trace(trace_op::attr_read, trace_mode::serial, obj.getId(), 0, N * sizeof(VT),
+                         attr_name.c_str());
   attr.read(attr.getDataType(), values.data());
 }
 
@@ -22,6 +27,8 @@ void read_attribute<std::string>(const H5::H5Object &obj, const std::string &att
 {
   H5::Attribute attr = obj.openAttribute(attr_name);
   H5::StrType str_type = attr.getStrType();
+  hdf5_trace_scope trace(trace_op::attr_read, trace_mode::serial, obj.getId(), 0,
+                         str_type.getSize(), attr_name.c_str());
   attr.read(str_type, value);
   value.resize(str_type.getSize());
 }
@@ -41,6 +48,8 @@ void write_attribute(const H5::H5Object &obj, const std::string &attr_name, cons
   {
     attr = obj.createAttribute(attr_name, dtype, scalar_space);
   }
+  hdf5_trace_scope trace(trace_op::attr_write, trace_mode::serial, obj.getId(), 0, sizeof(VT),
+                         attr_name.c_str());
   attr.write(dtype, &value);
 }
 
@@ -59,6 +68,8 @@ void write_attribute(const H5::H5Object &obj, const std::string &attr_name, cons
   {
     attr = obj.createAttribute(attr_name, dtype, dataspace); // default
   }
+  hdf5_trace_scope trace(trace_op::attr_write, trace_mode::serial, obj.getId(), 0,
+                         N * sizeof(VT), attr_name.c_str());
   attr.write(dtype, values.data());
 }
 
@@ -78,6 +89,8 @@ void write_attribute<std::string>(const H5::H5Object &obj, const std::string &at
   {
     attr = obj.createAttribute(attr_name, str_type, scalar_space);
   }
+  hdf5_trace_scope trace(trace_op::attr_write, trace_mode::serial, obj.getId(), 0, len,
+                         attr_name.c_str());
   attr.write(str_type, value);
 }
 
@@ -0,0 +1,156 @@
+#pragma once
+
+#include "timer_registry.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <string>
+#include <vector>
+
+// robust summary of one phase over repeated iterations
+struct sample_stats {
+  int n{0};
+  double min{0.0};
+  double q1{0.0};
+  double median{0.0};
+  double q3{0.0};
+  double max{0.0};
+  double mean{0.0};
+  // distribution-free 95% confidence interval of the median
+  double ci_lo{0.0};
+  double ci_hi{0.0};
+
+  double iqr() const { return q3 - q1; }
+};
+
+// linear interpolation between closest ranks, v must be sorted
+inline double sorted_quantile(const std::vector<double> &v, double q) {
+  const double pos = q * static_cast<double>(v.size() - 1);
+  const auto lo    = static_cast<std::size_t>(std::floor(pos));
+  const auto hi    = std::min(lo + 1, v.size() - 1);
+  return v[lo] + (pos - static_cast<double>(lo)) * (v[hi] - v[lo]);
+}
+
+inline sample_stats compute_sample_stats(std::vector<double> v) {
+  sample_stats s;
+  s.n = static_cast<int>(v.size());
+  if (v.empty())
+    return s;
+  std::sort(v.begin(), v.end());
+  s.min    = v.front();
+  s.max    = v.back();
+  s.q1     = sorted_quantile(v, 0.25);
+  s.median = sorted_quantile(v, 0.5);
+  s.q3     = sorted_quantile(v, 0.75);
+  for (auto x : v) {
+    s.mean += x;
+  }
+  s.mean /= s.n;
+
+  // [x_(j), x_(n-j+1)] covers the median with probability 1 - 2 P(Bin(n, 1/2) < j);
+  // take the largest j keeping that >= 95%, for very few samples this falls back to min/max
+  double cdf  = 0.0;  // P(Bin(n, 1/2) <= k)
+  double pmf  = std::pow(0.5, s.n);
+  int j       = 1;
+  for (int k = 0; k < s.n / 2; ++k) {
+    cdf += pmf;
+    if (2.0 * cdf > 0.05)
+      break;
+    j   = k + 1;
+    pmf = pmf * (s.n - k) / (k + 1);
+  }
+  s.ci_lo = v[j - 1];
+  s.ci_hi = v[s.n - j];
+  return s;
+}
+
+// Per iteration the wall time of a phase is its slowest rank, summarize those over iterations.
+// Collective over comm, the result is only valid on rank 0.
+inline std::vector<std::pair<std::string, sample_stats>> summarize_iterations(
+  const std::vector<timer_registry> &iterations, const mpicpp::comm &comm) {
+  std::vector<std::string> order;
+  std::map<std::string, std::vector<double>> per_phase;
+  for (auto const &reg : iterations) {
+    for (auto const &t : reg.reduce(comm)) {
+      auto [it, inserted] = per_phase.try_emplace(t.name);
+      if (inserted)
+        order.push_back(t.name);
+      it->second.push_back(t.max);
+    }
+  }
+  std::vector<std::pair<std::string, sample_stats>> out;
+  for (auto const &name : order) {
+    out.emplace_back(name, compute_sample_stats(per_phase[name]));
+  }
+  return out;
+}
+
+// Report columns <phase>_rss_mib_{min,max,sum} and <phase>_buf_mib_{min,max,sum}: per-rank
+// peak resident set and particle buffer MiB of every phase, reduced over ranks. Over several
+// iterations each value is the largest seen. Collective over comm, only valid on rank 0.
+inline report_meta memory_meta(const std::vector<timer_registry> &iterations,
+                               const mpicpp::comm &comm) {
+  std::vector<std::string> order;
+  std::map<std::string, reduced_memory> worst;
+  for (auto const &reg : iterations) {
+    for (auto const &m : reg.reduce_memory(comm)) {
+      auto [it, inserted] = worst.try_emplace(m.name, m);
+      if (inserted) {
+        order.push_back(m.name);
+        continue;
+      }
+      for (auto [w, r] : {std::pair{&it->second.rss, &m.rss}, std::pair{&it->second.buffers, &m.buffers}}) {
+        w->min = std::max(w->min, r->min);
+        w->max = std::max(w->max, r->max);
+        w->sum = std::max(w->sum, r->sum);
+      }
+    }
+  }
+  report_meta meta;
+  for (auto const &name : order) {
+    auto const &m = worst[name];
+    for (auto [what, r] : {std::pair{"rss", &m.rss}, std::pair{"buf", &m.buffers}}) {
+      meta.emplace_back(fmt::format("{}_{}_mib_min", name, what), fmt::format("{:.3f}", r->min));
+      meta.emplace_back(fmt::format("{}_{}_mib_max", name, what), fmt::format("{:.3f}", r->max));
+      meta.emplace_back(fmt::format("{}_{}_mib_sum", name, what), fmt::format("{:.3f}", r->sum));
+    }
+  }
+  return meta;
+}
+
+inline void print_stats_csv(const std::vector<std::pair<std::string, sample_stats>> &phases,
+                            const report_meta &meta = {}) {
+  std::vector<std::string> cols, vals;
+  for (auto const &[key, value] : meta) {
+    cols.push_back(key);
+    vals.push_back(value);
+  }
+  for (auto const &[name, s] : phases) {
+    for (auto [suffix, v] : {std::pair{"median", s.median}, std::pair{"q1", s.q1},
+                             std::pair{"q3", s.q3}, std::pair{"iqr", s.iqr()},
+                             std::pair{"ci95_lo", s.ci_lo}, std::pair{"ci95_hi", s.ci_hi}}) {
+      cols.push_back(fmt::format("{}_{}", name, suffix));
+      vals.push_back(fmt::format("{:.6f}", v));
+    }
+  }
+  fmt::print("{}\n", fmt::join(cols, ","));
+  fmt::print("{}\n", fmt::join(vals, ","));
+}
+
+inline void print_stats_json(const std::vector<std::pair<std::string, sample_stats>> &phases,
+                             const report_meta &meta = {}) {
+  fmt::print("{{\n  \"meta\": {{");
+  for (std::size_t i = 0; i < meta.size(); ++i) {
+    fmt::print("{}\n    \"{}\": \"{}\"", i ? "," : "", meta[i].first, meta[i].second);
+  }
+  fmt::print("\n  }},\n  \"phases\": [");
+  for (std::size_t i = 0; i < phases.size(); ++i) {
+    auto const &[name, s] = phases[i];
+    fmt::print(
+      "{}\n    {{\"name\": \"{}\", \"n\": {}, \"min\": {:.6f}, \"q1\": {:.6f}, \"median\": {:.6f}, "
+      "\"q3\": {:.6f}, \"max\": {:.6f}, \"mean\": {:.6f}, \"ci95\": [{:.6f}, {:.6f}]}}",
+      i ? "," : "", name, s.n, s.min, s.q1, s.median, s.q3, s.max, s.mean, s.ci_lo, s.ci_hi);
+  }
+  fmt::print("\n  ]\n}}\n");
+}
@@ -0,0 +1,310 @@
+#pragma once
+
+#include <H5Cpp.h>
+#include <fcntl.h>
+#include <fmt/format.h>
+#include <mpi.h>
+#include <mpicpp.hpp>
+#include <unistd.h>
+
+#include "attribute_helper.hpp"
+#include "file_staging.hpp"
+#include "general_utils.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <initializer_list>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+// --columnar-out / --columnar-in: a snapshot as a directory `snap_099.N.cols` with one raw
+// column file per particle dataset, `PartTypeN.Field`, holding the rows in file order as native
+// little-endian values from offset 0, so every column can be mapped page aligned. The `manifest`
+// holds the shapes, types and unit attributes of the columns plus an HDF5 file image with
+// /Header, /Config and /Parameters. It is written last, a directory without it is incomplete.
+//
+// manifest: "SNAPCOL1", u32 version, u64 image size, image, u32 column count, then per column
+// str path, u8 kind ('f', 'i' or 'u'), u8 element size, u8 rank, u64 dims[rank], u32 attribute
+// count and per attribute str name, f64 value. str is a u32 length and the bytes.
+
+constexpr char columnar_magic[8]       = {'S', 'N', 'A', 'P', 'C', 'O', 'L', '1'};
+constexpr std::uint32_t columnar_version = 1;
+
+inline std::filesystem::path snap_columns_path(const std::filesystem::path &files_dir,
+                                               const int file_idx) {
+  return fmt::format("{}/snap_099.{}.cols", files_dir.string(), file_idx);
+}
+
+// complete columnar snapshots in `dir`, the counterpart of count_hdf5_files
+inline int count_columnar_snapshots(const std::filesystem::path &dir) {
+  int numfiles = 0;
+  for (auto &entry : std::filesystem::directory_iterator(dir)) {
+    const auto name = entry.path().filename().string();
+    if (name.rfind("snap_", 0) == 0 && entry.path().extension() == ".cols" &&
+        std::filesystem::exists(entry.path() / "manifest"))
+      ++numfiles;
+  }
+  if (numfiles == 0)
+    throw std::runtime_error(
+      fmt::format("No complete snap_*.cols directories found in: {}\n", dir.string()));
+  return numfiles;
+}
+
+// drop_page_cache for every file of the columnar snapshot `dir`
+inline void drop_columns_cache(const std::filesystem::path &dir) {
+  if (!std::filesystem::is_directory(dir))
+    return;
+  for (auto &entry : std::filesystem::directory_iterator(dir))
+    drop_page_cache(entry.path());
+}
+
+template <typename VT>
+constexpr char column_kind() {
+  return std::is_floating_point_v<VT> ? 'f' : std::is_signed_v<VT> ? 'i' : 'u';
+}
+
+// one particle dataset of the manifest
+struct column_entry {
+  std::string path{};  // "PartType1/Coordinates"
+  char kind{'f'};
+  std::uint8_t elem_size{0};
+  std::vector<std::uint64_t> dims{};
+  std::vector<std::pair<std::string, double>> attributes{};
+
+  // name of the column file inside the snapshot directory
+  std::string file_name() const {
+    auto name = path;
+    std::replace(name.begin(), name.end(), '/', '.');
+    return name;
+  }
+};
+
+struct column_manifest {
+  std::vector<char> image{};
+  std::vector<column_entry> columns{};
+
+  const column_entry &find(const std::string &path) const {
+    for (auto const &col : columns) {
+      if (col.path == path)
+        return col;
+    }
+    throw std::runtime_error(fmt::format("column_manifest: no column {}", path));
+  }
+
+  std::vector<char> serialize() const {
+    std::vector<char> out(std::begin(columnar_magic), std::end(columnar_magic));
+    auto put = [&](const auto &value) {
+      const char *p = reinterpret_cast<const char *>(&value);
+      out.insert(out.end(), p, p + sizeof(value));
+    };
+    auto put_str = [&](const std::string &s) {
+      put(static_cast<std::uint32_t>(s.size()));
+      out.insert(out.end(), s.begin(), s.end());
+    };
+    put(columnar_version);
+    put(static_cast<std::uint64_t>(image.size()));
+    out.insert(out.end(), image.begin(), image.end());
+    put(static_cast<std::uint32_t>(columns.size()));
+    for (auto const &col : columns) {
+      put_str(col.path);
+      put(col.kind);
+      put(col.elem_size);
+      put(static_cast<std::uint8_t>(col.dims.size()));
+      for (auto d : col.dims)
+        put(d);
+      put(static_cast<std::uint32_t>(col.attributes.size()));
+      for (auto const &[name, value] : col.attributes) {
+        put_str(name);
+        put(value);
+      }
+    }
+    return out;
+  }
+
+  static column_manifest parse(const std::vector<char> &bytes, const std::string &what) {
+    std::size_t pos = 0;
+    auto take       = [&](void *dst, std::size_t n) {
+      if (bytes.size() - pos < n)
+        throw std::runtime_error(fmt::format("column_manifest: {} is truncated", what));
+      std::memcpy(dst, bytes.data() + pos, n);
+      pos += n;
+    };
+    auto get = [&](auto &value) { take(&value, sizeof(value)); };
+    auto get_str = [&](std::string &s) {
+      std::uint32_t n = 0;
+      get(n);
+      s.resize(n);
+      take(s.data(), n);
+    };
+    char magic[sizeof(columnar_magic)];
+    std::uint32_t version = 0;
+    get(magic);
+    get(version);
+    if (std::memcmp(magic, columnar_magic, sizeof(magic)) != 0 || version != columnar_version)
+      throw std::runtime_error(fmt::format("column_manifest: {} is not a version {} manifest",
+                                           what, columnar_version));
+    column_manifest m;
+    std::uint64_t image_bytes = 0;
+    get(image_bytes);
+    m.image.resize(image_bytes);
+    take(m.image.data(), image_bytes);
+    std::uint32_t ncolumns = 0;
+    get(ncolumns);
+    m.columns.resize(ncolumns);
+    for (auto &col : m.columns) {
+      get_str(col.path);
+      get(col.kind);
+      get(col.elem_size);
+      std::uint8_t rank = 0;
+      get(rank);
+      col.dims.resize(rank);
+      for (auto &d : col.dims)
+        get(d);
+      std::uint32_t nattrs = 0;
+      get(nattrs);
+      col.attributes.resize(nattrs);
+      for (auto &[name, value] : col.attributes) {
+        get_str(name);
+        get(value);
+      }
+    }
+    return m;
+  }
+
+  // the attribute groups, readable with read_from_file_parallel on every rank
+  H5::H5File open_groups() const {
+    static int opened = 0;
+    auto copy         = image;
+    return open_file_image("columns." + std::to_string(opened++), copy);
+  }
+};
+
+// image of an in-memory HDF5 file with `groups` written into it
+inline std::vector<char> attribute_groups_image(std::initializer_list<const groups_base *> groups) {
+  static int created = 0;
+  const std::string name = "manifest." + std::to_string(created++);
+  const hid_t fapl       = core_fapl();
+  const hid_t id         = H5Fcreate(name.c_str(), H5F_ACC_TRUNC, H5P_DEFAULT, fapl);
+  H5Pclose(fapl);
+  if (id < 0)
+    throw std::runtime_error("attribute_groups_image: cannot create " + name);
+  H5::H5File file(id);
+  // the C++ handle took its own reference
+  H5Fclose(id);
+  for (const groups_base *group : groups)
+    group->write_to_file_parallel(file);
+  H5Fflush(file.getId(), H5F_SCOPE_LOCAL);
+  std::vector<char> image(static_cast<std::size_t>(H5Fget_file_image(file.getId(), nullptr, 0)));
+  H5Fget_file_image(file.getId(), image.data(), image.size());
+  return image;
+}
+
+// Collective over `comm`: the manifest of the snapshot in `dir`, read by rank 0 and broadcast
+inline column_manifest read_manifest(const std::filesystem::path &dir, const mpicpp::comm &comm) {
+  const auto path = dir / "manifest";
+  std::vector<char> bytes;
+  if (comm.rank() == 0) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in)
+      throw std::runtime_error(fmt::format("read_manifest: cannot open {}", path.string()));
+    bytes.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+  }
+  unsigned long long size = bytes.size();
+  MPI_Bcast(&size, 1, MPI_UNSIGNED_LONG_LONG, 0, comm.get());
+  if (size > INT_MAX)
+    throw std::runtime_error("read_manifest: manifest larger than 2 GiB");
+  bytes.resize(size);
+  MPI_Bcast(bytes.data(), static_cast<int>(size), MPI_BYTE, 0, comm.get());
+  return column_manifest::parse(bytes, path.string());
+}
+
+// Island rank 0 alone: `bytes` from `data` as the whole content of `path`
+inline void write_column_posix(const std::string &path, const void *data, std::uint64_t bytes) {
+  const int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0)
+    throw std::runtime_error(fmt::format("write_column_posix: open {}: {}", path,
+                                         std::strerror(errno)));
+  const char *p = static_cast<const char *>(data);
+  for (std::uint64_t done = 0; done < bytes;) {
+    const ssize_t n = pwrite(fd, p + done, bytes - done, static_cast<off_t>(done));
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0) {
+      const int error = errno;
+      close(fd);
+      throw std::runtime_error(fmt::format("write_column_posix: write {}: {}", path,
+                                           std::strerror(error)));
+    }
+    done += static_cast<std::uint64_t>(n);
+  }
+  close(fd);
+}
+
+// Collective over `comm`: every rank writes its `bytes` at byte `offset` of `path`, which is
+// created or cut to `total` bytes. Transfers go in rounds of at most 1 GiB per rank, as many
+// rounds on every rank, for the int counts of MPI.
+inline void write_column_mpiio(const std::string &path, const void *data, std::uint64_t offset,
+                               std::uint64_t bytes, std::uint64_t total,
+                               const mpicpp::comm &comm) {
+  constexpr std::uint64_t round_bytes = std::uint64_t{1} << 30;
+  MPI_File fh;
+  if (MPI_File_open(comm.get(), path.c_str(), MPI_MODE_CREATE | MPI_MODE_WRONLY, MPI_INFO_NULL,
+                    &fh) != MPI_SUCCESS)
+    throw std::runtime_error(fmt::format("write_column_mpiio: cannot open {}", path));
+  MPI_File_set_size(fh, static_cast<MPI_Offset>(total));
+  unsigned long long rounds = (bytes + round_bytes - 1) / round_bytes, most = 0;
+  MPI_Allreduce(&rounds, &most, 1, MPI_UNSIGNED_LONG_LONG, MPI_MAX, comm.get());
+  const char *p = static_cast<const char *>(data);
+  for (unsigned long long r = 0; r < most; ++r) {
+    const std::uint64_t begin = std::min<std::uint64_t>(bytes, r * round_bytes);
+    const std::uint64_t n     = std::min(bytes - begin, round_bytes);
+    MPI_File_write_at_all(fh, static_cast<MPI_Offset>(offset + begin), p + begin,
+                          static_cast<int>(n), MPI_BYTE, MPI_STATUS_IGNORE);
+  }
+  MPI_File_close(&fh);
+}
+
+// One columnar snapshot being written: every island rank constructs it, island rank 0 creates
+// `dir` and keeps the manifest entries of the columns written into it.
+struct column_writer {
+  std::filesystem::path dir;
+  const mpicpp::comm &comm;
+  column_manifest manifest{};
+
+  column_writer(std::filesystem::path dir_, const mpicpp::comm &comm_)
+      : dir(std::move(dir_)), comm(comm_) {
+    if (comm.rank() == 0) {
+      std::filesystem::create_directories(dir);
+      // the old manifest goes first, the directory is incomplete until finish()
+      std::filesystem::remove(dir / "manifest");
+    }
+    MPI_Barrier(comm.get());
+  }
+
+  std::string column_path(const column_entry &col) const { return (dir / col.file_name()).string(); }
+
+  // Collective, after every column: island rank 0 adds the attribute groups and writes the
+  // manifest under a temporary name, renamed once complete.
+  void finish(std::initializer_list<const groups_base *> groups) {
+    MPI_Barrier(comm.get());
+    if (comm.rank() != 0)
+      return;
+    manifest.image  = attribute_groups_image(groups);
+    const auto body = manifest.serialize();
+    const auto tmp  = dir / "manifest.tmp";
+    {
+      std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+      out.write(body.data(), static_cast<std::streamsize>(body.size()));
+      if (!out)
+        throw std::runtime_error(fmt::format("column_writer: cannot write {}", tmp.string()));
+    }
+    std::filesystem::rename(tmp, dir / "manifest");
+  }
+};
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <mpi.h>
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+
+// Hashes behind --resume: a source fingerprint that identifies what a dataset was copied from,
+// and a content hash of the rows that does not depend on how they are partitioned.
+
+inline std::uint64_t fnv1a(const void *data, std::size_t bytes,
+                           std::uint64_t h = 0xcbf29ce484222325ULL) {
+  auto p = static_cast<const unsigned char *>(data);
+  for (std::size_t i = 0; i < bytes; ++i) {
+    h ^= p[i];
+    h *= 0x100000001b3ULL;
+  }
+  return h;
+}
+
+inline std::uint64_t splitmix64(std::uint64_t x) {
+  x += 0x9e3779b97f4a7c15ULL;
+  x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+  return x ^ (x >> 31);
+}
+
+// input file path and modification time, dataset path, dims and element size
+template <typename Dims>
+std::uint64_t source_fingerprint(const std::filesystem::path &source,
+                                 const std::string &dataset_path, const Dims &dims,
+                                 std::size_t elem_size) {
+  const auto path  = std::filesystem::absolute(source).lexically_normal().string();
+  const auto mtime = static_cast<std::int64_t>(
+    std::filesystem::last_write_time(source).time_since_epoch().count());
+  std::uint64_t h = fnv1a(path.data(), path.size());
+  h               = fnv1a(&mtime, sizeof(mtime), h);
+  h               = fnv1a(dataset_path.data(), dataset_path.size(), h);
+  for (auto d : dims) {
+    const std::uint64_t d64 = d;
+    h                       = fnv1a(&d64, sizeof(d64), h);
+  }
+  const std::uint64_t e64 = elem_size;
+  return fnv1a(&e64, sizeof(e64), h);
+}
+
+// Collective over `comm`: sum over all rows of a hash of (global row index, row bytes). Every
+// rank holds `rows` consecutive rows of `row_bytes`, in rank order. Without `ordered` the row
+// index is left out, so any permutation of the rows gives the same hash.
+inline std::uint64_t content_hash(const void *data, std::uint64_t rows, std::size_t row_bytes,
+                                  MPI_Comm comm, bool ordered = true) {
+  std::uint64_t first = 0;
+  MPI_Exscan(&rows, &first, 1, MPI_UINT64_T, MPI_SUM, comm);
+  int rank;
+  MPI_Comm_rank(comm, &rank);
+  if (rank == 0)
+    first = 0;
+  auto p            = static_cast<const unsigned char *>(data);
+  std::uint64_t sum = 0;
+  for (std::uint64_t r = 0; r < rows; ++r) {
+    const std::uint64_t key = ordered ? splitmix64(first + r) : 0;
+    sum += splitmix64(fnv1a(p + r * row_bytes, row_bytes) ^ key);
+  }
+  std::uint64_t total = 0;
+  MPI_Allreduce(&sum, &total, 1, MPI_UINT64_T, MPI_SUM, comm);
+  return total;
+}
@@ -0,0 +1,128 @@
+#pragma once
+
+#include "unit_conversion.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <fmt/format.h>
+
+// --derived: fields computed per rank from float datasets of one PartType right after they are
+// read, and written next to them. Each field names the datasets it needs, with --derived-only
+// nothing else is read. Kernels see their inputs in physical CGS through the to_cgs factor of
+// derived_input, whatever units the rows are held in.
+
+// header values the kernels may use
+struct derived_context {
+  double a{1.0};
+  double h{1.0};
+  double omega0{0.0};
+  double omega_lambda{0.0};
+};
+
+struct derived_input {
+  const float *rows;
+  // brings the rows to physical CGS, 1 when they already are or are dimensionless, to_cgs
+  // for physical rows that kept it
+  double to_cgs;
+};
+
+struct derived_field {
+  const char *name;
+  const char *group;
+  std::vector<const char *> inputs;
+  // to_cgs attribute and unit system of the output, its other unit attributes are 0
+  double to_cgs;
+  unit_system units;
+  // out[i] from in[k].rows[i] for the inputs in declaration order, n rows of this rank
+  void (*compute)(const derived_context &, const derived_input *in, float *out, std::size_t n);
+};
+
+constexpr double hydrogen_mass_fraction = 0.76;
+constexpr double proton_mass_cgs        = 1.672621924e-24;
+constexpr double boltzmann_cgs          = 1.380649e-16;
+constexpr double solar_metallicity      = 0.0127;
+constexpr double seconds_per_gyr        = 3.15576e16;
+// 1 / (100 km/s/Mpc) in Gyr
+constexpr double hubble_time_gyr = 9.777922216807891;
+
+// T = (gamma - 1) u mu / k_B with gamma = 5/3 and the mean molecular weight
+// mu = 4 m_p / (1 + 3 X + 4 X x_e) of a hydrogen/helium gas
+inline void derive_temperature(const derived_context &, const derived_input *in, float *out,
+                               std::size_t n) {
+  const double c   = 2.0 / 3.0 * in[0].to_cgs * 4.0 * proton_mass_cgs / boltzmann_cgs;
+  const double x   = hydrogen_mass_fraction;
+  const float *u   = in[0].rows;
+  const float *x_e = in[1].rows;
+  for (std::size_t i = 0; i < n; ++i)
+    out[i] = static_cast<float>(c * u[i] / (1.0 + 3.0 * x + 4.0 * x * x_e[i]));
+}
+
+inline void derive_metallicity_solar(const derived_context &, const derived_input *in,
+                                     float *out, std::size_t n) {
+  const double c = 1.0 / solar_metallicity;
+  const float *z = in[0].rows;
+  for (std::size_t i = 0; i < n; ++i)
+    out[i] = static_cast<float>(z[i] * c);
+}
+
+// Cosmic time at scale factor `a` in Gyr for a flat universe of matter and Lambda.
+inline double cosmic_time_gyr(const derived_context &ctx, double a) {
+  const double t_h = hubble_time_gyr / ctx.h;
+  if (ctx.omega_lambda <= 0)
+    return 2.0 / 3.0 * t_h * a * std::sqrt(a);
+  const double sl = std::sqrt(ctx.omega_lambda);
+  return 2.0 / (3.0 * sl) * t_h * std::asinh(std::sqrt(ctx.omega_lambda / ctx.omega0) * a *
+                                             std::sqrt(a));
+}
+
+// Age at the snapshot time from the formation scale factor. Wind particles store a formation
+// time <= 0 and get NaN.
+inline void derive_stellar_age(const derived_context &ctx, const derived_input *in, float *out,
+                               std::size_t n) {
+  const double now = cosmic_time_gyr(ctx, ctx.a);
+  const float *a   = in[0].rows;
+  for (std::size_t i = 0; i < n; ++i)
+    out[i] = a[i] > 0 ? static_cast<float>(now - cosmic_time_gyr(ctx, a[i])) : std::nanf("");
+}
+
+inline const std::vector<derived_field> &derived_registry() {
+  static const std::vector<derived_field> fields{
+    {"Temperature", "PartType0", {"InternalEnergy", "ElectronAbundance"}, 1.0,
+     unit_system::physical_cgs, derive_temperature},
+    {"Metallicity_Solar", "PartType0", {"GFM_Metallicity"}, 0.0, unit_system::code,
+     derive_metallicity_solar},
+    {"StellarAge", "PartType4", {"GFM_StellarFormationTime"}, seconds_per_gyr,
+     unit_system::code, derive_stellar_age},
+  };
+  return fields;
+}
+
+// the registered fields of a comma separated list of names, throws on an unknown one
+inline std::vector<const derived_field *> parse_derived_fields(const std::string &list) {
+  std::vector<const derived_field *> found;
+  std::size_t begin = 0;
+  while (begin < list.size()) {
+    const std::size_t end  = std::min(list.find(',', begin), list.size());
+    const std::string name = list.substr(begin, end - begin);
+    begin                  = end + 1;
+    if (name.empty())
+      continue;
+    const derived_field *match = nullptr;
+    std::vector<std::string> known;
+    for (auto const &field : derived_registry()) {
+      known.emplace_back(field.name);
+      if (name == field.name)
+        match = &field;
+    }
+    if (!match)
+      throw std::runtime_error(
+        fmt::format("unknown derived field {}, known: {}\n", name, fmt::join(known, ", ")));
+    found.push_back(match);
+  }
+  return found;
+}
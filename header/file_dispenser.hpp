@@ -0,0 +1,56 @@
+#pragma once
+
+#include "mpi_helpers.hpp"
+
+#include <mpi.h>
+
+// Hands out snapshot files to islands on demand: a counter on world rank 0, advanced with
+// passive-target MPI_Fetch_and_op by whichever island root asks first. Island `i` starts
+// with file `i` (its colour), so the counter starts at num_islands.
+struct file_dispenser {
+  MPI_Win win{MPI_WIN_NULL};
+  int *counter{nullptr};
+  int num_files{0};
+  int num_islands{0};
+
+  // collective over world_comm
+  explicit file_dispenser(const mpi_state &state)
+      : num_files(state.num_files), num_islands(state.num_islands) {
+    const MPI_Aint bytes = state.w_rank == 0 ? sizeof(int) : 0;
+    MPI_Win_allocate(bytes, sizeof(int), MPI_INFO_NULL, state.world_comm.get(), &counter, &win);
+    // passive epoch for the lifetime of the window
+    MPI_Win_lock_all(MPI_MODE_NOCHECK, win);
+    reset(state);
+  }
+
+  file_dispenser(const file_dispenser &)            = delete;
+  file_dispenser &operator=(const file_dispenser &) = delete;
+
+  ~file_dispenser() {
+    MPI_Win_unlock_all(win);
+    MPI_Win_free(&win);
+  }
+
+  // collective over world_comm, every file is unprocessed again afterwards
+  void reset(const mpi_state &state) {
+    MPI_Barrier(state.world_comm.get());
+    if (state.w_rank == 0)
+      *counter = num_islands;
+    MPI_Win_sync(win);
+    MPI_Barrier(state.world_comm.get());
+  }
+
+  // collective over the island: the next unprocessed file, -1 once all are taken
+  int next(const mpi_state &state) {
+    int file = -1;
+    if (state.i_rank == 0) {
+      const int one = 1;
+      MPI_Fetch_and_op(&one, &file, MPI_INT, 0, 0, MPI_SUM, win);
+      MPI_Win_flush(0, win);
+      if (file >= num_files)
+        file = -1;
+    }
+    MPI_Bcast(&file, 1, MPI_INT, 0, state.island_comm.get());
+    return file;
+  }
+};
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <H5Cpp.h>
+#include <mpi.h>
+#include <mpicpp.hpp>
+
+#include <climits>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <initializer_list>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// --stage-headers: island rank 0 copies the attribute groups of its input into an in-memory
+// HDF5 file (core driver, no backing store) and broadcasts the file image. Every rank then
+// reads the attributes from its own copy, one broadcast instead of one small read or broadcast
+// per attribute.
+
+// inputs up to this size are read whole with one sequential read and copied from memory,
+// larger ones are copied group by group from the file
+constexpr std::uintmax_t stage_whole_file_below = std::uintmax_t{64} << 20;
+
+inline hid_t core_fapl() {
+  const hid_t fapl = H5Pcreate(H5P_FILE_ACCESS);
+  H5Pset_fapl_core(fapl, 1 << 16, false);
+  return fapl;
+}
+
+// opens a file image read-only, HDF5 keeps its own copy of `image`
+inline H5::H5File open_file_image(const std::string &name, std::vector<char> &image) {
+  const hid_t fapl = core_fapl();
+  H5Pset_file_image(fapl, image.data(), image.size());
+  const hid_t file = H5Fopen(name.c_str(), H5F_ACC_RDONLY, fapl);
+  H5Pclose(fapl);
+  if (file < 0)
+    throw std::runtime_error("open_file_image: cannot open the image of " + name);
+  H5::H5File handle(file);
+  // the C++ handle took its own reference
+  H5Fclose(file);
+  return handle;
+}
+
+// image of a new in-memory file holding copies of `groups` of `src`
+inline std::vector<char> copy_groups_to_image(const H5::H5File &src,
+                                              std::initializer_list<const char *> groups) {
+  const std::string name = src.getFileName() + ".staged";
+  const hid_t fapl       = core_fapl();
+  const hid_t dst        = H5Fcreate(name.c_str(), H5F_ACC_TRUNC, H5P_DEFAULT, fapl);
+  H5Pclose(fapl);
+  if (dst < 0)
+    throw std::runtime_error("copy_groups_to_image: cannot create " + name);
+  for (const char *group : groups) {
+    if (H5Lexists(src.getId(), group, H5P_DEFAULT) > 0)
+      H5Ocopy(src.getId(), group, dst, group, H5P_DEFAULT, H5P_DEFAULT);
+  }
+  H5Fflush(dst, H5F_SCOPE_LOCAL);
+  std::vector<char> image(static_cast<std::size_t>(H5Fget_file_image(dst, nullptr, 0)));
+  H5Fget_file_image(dst, image.data(), image.size());
+  H5Fclose(dst);
+  return image;
+}
+
+// Collective over `comm`: every rank gets a read-only in-memory file with `groups` of the input
+// `file`, which only has to be open on rank 0.
+inline H5::H5File stage_groups(const H5::H5File &file, std::initializer_list<const char *> groups,
+                               const mpicpp::comm &comm) {
+  std::vector<char> image;
+  std::string name;
+  if (comm.rank() == 0) {
+    name            = file.getFileName();
+    const auto size = std::filesystem::file_size(name);
+    if (size < stage_whole_file_below) {
+      std::vector<char> whole(size);
+      std::ifstream in(name, std::ios::binary);
+      in.read(whole.data(), static_cast<std::streamsize>(size));
+      if (!in)
+        throw std::runtime_error("stage_groups: short read of " + name);
+      // a label of its own, the input itself is still open through the POSIX driver
+      image = copy_groups_to_image(open_file_image(name + ".image", whole), groups);
+    } else {
+      image = copy_groups_to_image(file, groups);
+    }
+  }
+  unsigned long long bytes = image.size();
+  MPI_Bcast(&bytes, 1, MPI_UNSIGNED_LONG_LONG, 0, comm.get());
+  if (bytes > INT_MAX)
+    throw std::runtime_error("stage_groups: image larger than 2 GiB");
+  image.resize(bytes);
+  MPI_Bcast(image.data(), static_cast<int>(bytes), MPI_BYTE, 0, comm.get());
+  static int staged = 0;
+  return open_file_image("staged." + std::to_string(staged++), image);
+}
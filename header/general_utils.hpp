@@ -1,6 +1,8 @@
 #pragma once
 
 #include <H5Cpp.h>
+#include <fcntl.h>
+#include <unistd.h>
 #include <fmt/format.h>
 #include <fmt/ranges.h>
 #include <filesystem>
@@ -44,6 +46,17 @@ int exception_handler() {
   return EXIT_FAILURE;
 }
 
+// Ask the kernel to forget cached pages of a file so the next read comes from storage.
+// Only affects the local page cache; parallel file system servers keep their own caches.
+inline void drop_page_cache(const std::filesystem::path &fname) {
+  int fd = open(fname.c_str(), O_RDONLY);
+  if (fd < 0)
+    return;
+  fdatasync(fd);
+  posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+  close(fd);
+}
+
 std::filesystem::path create_out_files_dir(const std::filesystem::path &in_files_dir,
                                            const mpi_state &state,
                                            const std::string &outdirname = "out") {
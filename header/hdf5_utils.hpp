@@ -92,27 +92,52 @@ inline H5::DSetMemXferPropList create_mpi_xfer(H5FD_mpio_xfer_t mode = H5FD_MPIO
   return plist;
 }
 
+inline std::filesystem::path snap_file_path(const std::filesystem::path &files_dir, const int file_idx)
+{
+  return fmt::format("{}/snap_099.{}.hdf5", files_dir.string(), file_idx);
+}
+
 H5::H5File create_parallel_file_handle(const std::filesystem::path &outfiles_dir, const mpicpp::comm &island_comm, const int island_colour, unsigned int flags = H5F_ACC_TRUNC)
 {
-  auto ofname = fmt::format("{}/snap_099.{}.hdf5", outfiles_dir.string(), island_colour);
+  auto ofname = snap_file_path(outfiles_dir, island_colour).string();
   auto facc = create_mpi_fapl(island_comm);
   return {ofname, flags, facc};
 }
 
+// opens the island's current file with an MPI-IO property list reused across its file queue
+H5::H5File create_parallel_file_handle(const std::filesystem::path &outfiles_dir, const mpi_state &state, unsigned int flags, const H5::FileAccPropList &facc)
+{
+  return {snap_file_path(outfiles_dir, state.i_file).string(), flags, facc};
+}
+
 H5::H5File create_parallel_file_handle(const std::filesystem::path &outfiles_dir, const mpi_state &state, unsigned int flags = H5F_ACC_TRUNC)
 {
-  return create_parallel_file_handle(outfiles_dir, state.island_comm, state.i_color, flags);
+  return create_parallel_file_handle(outfiles_dir, state.island_comm, state.i_file, flags);
 }
 
 H5::H5File create_serial_file_handle(const std::filesystem::path &files_dir, const mpicpp::comm &island_comm, const int island_colour, unsigned int flags = H5F_ACC_TRUNC)
 {
-  if (island_comm.rank() != 0 && flags == H5F_ACC_TRUNC)
+  if (island_comm.rank() != 0 && flags != H5F_ACC_RDONLY)
     return {};
-  auto ofname = fmt::format("{}/snap_099.{}.hdf5", files_dir.string(), island_colour);
+  auto ofname = snap_file_path(files_dir, island_colour).string();
   return {ofname, flags};
 }
 
 H5::H5File create_serial_file_handle(const std::filesystem::path &files_dir, const mpi_state &state, unsigned int flags = H5F_ACC_TRUNC)
 {
-  return create_serial_file_handle(files_dir, state.island_comm, state.i_color, flags);
+  return create_serial_file_handle(files_dir, state.island_comm, state.i_file, flags);
+}
+
+// --resume reopens an existing output file, where groups may already be there
+inline H5::Group open_or_create_group(const H5::Group &loc, const std::string &name)
+{
+  return loc.nameExists(name) ? loc.openGroup(name) : loc.createGroup(name);
+}
+
+inline void unlink_if_exists(const H5::Group &loc, const std::string &name)
+{
+  if (loc.nameExists(name))
+  {
+    loc.unlink(name);
+  }
 }
@@ -0,0 +1,188 @@
+#pragma once
+
+#include <H5Cpp.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+// --id-codec: HDF5 filter for the std::uint64_t ID columns (ParticleIDs, ParentID, TracerID).
+// Each chunk is stored as its first value followed by the deltas of consecutive values, zigzag
+// mapped so that small steps in either direction become small integers, and bit-packed in blocks
+// of id_codec_block values with one bit width per block. Nearly sorted or dense IDs need a few
+// bits per value instead of 64. The filter is optional: chunks it cannot shrink are stored raw.
+//
+// chunk: u64 count, u64 first value, then per block u8 width and ceil(n * width / 8) bytes of
+// little-endian bit stream.
+
+// in the range HDF5 leaves for unregistered filters
+constexpr H5Z_filter_t id_codec_filter = 311;
+constexpr std::size_t id_codec_block   = 128;
+constexpr hsize_t id_codec_chunk_rows  = hsize_t{1} << 16;
+
+inline std::uint64_t zigzag(std::uint64_t delta) {
+  return (delta << 1) ^ static_cast<std::uint64_t>(static_cast<std::int64_t>(delta) >> 63);
+}
+
+inline std::uint64_t unzigzag(std::uint64_t z) { return (z >> 1) ^ (~(z & 1) + 1); }
+
+inline std::vector<unsigned char> encode_ids(const std::uint64_t *x, std::size_t n) {
+  std::vector<unsigned char> out(2 * sizeof(std::uint64_t));
+  const std::uint64_t count = n, first = n ? x[0] : 0;
+  std::memcpy(out.data(), &count, sizeof(count));
+  std::memcpy(out.data() + sizeof(count), &first, sizeof(first));
+  std::uint64_t z[id_codec_block];
+  for (std::size_t b = 1; b < n; b += id_codec_block) {
+    const std::size_t m = std::min(id_codec_block, n - b);
+    std::uint64_t all   = 0;
+    for (std::size_t i = 0; i < m; ++i) {
+      z[i] = zigzag(x[b + i] - x[b + i - 1]);
+      all |= z[i];
+    }
+    const unsigned width = all ? 64 - __builtin_clzll(all) : 0;
+    out.push_back(static_cast<unsigned char>(width));
+    const std::size_t at = out.size();
+    // one spare word, every value is or-ed in as a whole 64-bit store
+    out.resize(at + (m * width + 7) / 8 + sizeof(std::uint64_t));
+    for (std::size_t i = 0; i < m && width; ++i) {
+      const std::size_t bit = i * width;
+      unsigned char *p      = out.data() + at + bit / 8;
+      const unsigned shift  = bit % 8;
+      std::uint64_t word;
+      std::memcpy(&word, p, sizeof(word));
+      word |= z[i] << shift;
+      std::memcpy(p, &word, sizeof(word));
+      // a value of more than 56 bits can reach into a ninth byte
+      if (shift + width > 64)
+        p[8] |= static_cast<unsigned char>(z[i] >> (64 - shift));
+    }
+    out.resize(at + (m * width + 7) / 8);
+  }
+  return out;
+}
+
+// Decodes a chunk written by encode_ids into `x`, which holds `capacity` values. False if the
+// chunk is malformed. Unpacking and the zigzag step are separate loops over independent values
+// that the compiler can vectorize, only the final prefix sum is sequential.
+inline bool decode_ids(const unsigned char *in, std::size_t bytes, std::uint64_t *x,
+                       std::size_t capacity) {
+  std::uint64_t count = 0, first = 0;
+  if (bytes < 2 * sizeof(std::uint64_t))
+    return false;
+  std::memcpy(&count, in, sizeof(count));
+  std::memcpy(&first, in + sizeof(count), sizeof(first));
+  if (count > capacity)
+    return false;
+  if (count == 0)
+    return true;
+  std::size_t pos = 2 * sizeof(std::uint64_t);
+  x[0]            = first;
+  // a block copied into zero padding, so every value is one unaligned load
+  unsigned char packed[id_codec_block * sizeof(std::uint64_t) + 2 * sizeof(std::uint64_t)];
+  std::uint64_t z[id_codec_block];
+  for (std::size_t b = 1; b < count; b += id_codec_block) {
+    const std::size_t m = std::min<std::size_t>(id_codec_block, count - b);
+    if (pos >= bytes)
+      return false;
+    const unsigned width = in[pos++];
+    const std::size_t n  = (m * width + 7) / 8;
+    if (width > 64 || bytes - pos < n)
+      return false;
+    std::memset(packed, 0, sizeof(packed));
+    std::memcpy(packed, in + pos, n);
+    pos += n;
+    const std::uint64_t mask = width == 64 ? ~std::uint64_t{0} : (std::uint64_t{1} << width) - 1;
+    for (std::size_t i = 0; i < m; ++i) {
+      const std::size_t bit = i * width;
+      const unsigned shift  = bit % 8;
+      std::uint64_t lo, hi;
+      std::memcpy(&lo, packed + bit / 8, sizeof(lo));
+      std::memcpy(&hi, packed + bit / 8 + 8, sizeof(hi));
+      // hi only matters when the value reaches into the ninth byte
+      const std::uint64_t spill = shift ? hi << (64 - shift) : 0;
+      z[i]                      = ((lo >> shift) | spill) & mask;
+    }
+    for (std::size_t i = 0; i < m; ++i)
+      z[i] = unzigzag(z[i]);
+    for (std::size_t i = 0; i < m; ++i)
+      x[b + i] = x[b + i - 1] + z[i];
+  }
+  return pos == bytes;
+}
+
+// H5Z_func_t of the filter, 0 tells HDF5 to store the chunk unfiltered (optional filter) or
+// that it cannot be read back
+inline size_t id_codec_apply(unsigned int flags, size_t, const unsigned int[], size_t nbytes,
+                             size_t *buf_size, void **buf) {
+  if (flags & H5Z_FLAG_REVERSE) {
+    // the decoded size is in the chunk itself
+    std::uint64_t count = 0;
+    if (nbytes < sizeof(count))
+      return 0;
+    std::memcpy(&count, *buf, sizeof(count));
+    const std::size_t out_bytes = count * sizeof(std::uint64_t);
+    void *out                   = H5allocate_memory(std::max<std::size_t>(out_bytes, 1), false);
+    if (!out)
+      return 0;
+    if (!decode_ids(static_cast<const unsigned char *>(*buf), nbytes,
+                    static_cast<std::uint64_t *>(out), count)) {
+      H5free_memory(out);
+      return 0;
+    }
+    H5free_memory(*buf);
+    *buf      = out;
+    *buf_size = out_bytes;
+    return out_bytes;
+  }
+  if (nbytes % sizeof(std::uint64_t) != 0)
+    return 0;
+  std::vector<std::uint64_t> ids(nbytes / sizeof(std::uint64_t));
+  std::memcpy(ids.data(), *buf, nbytes);
+  const auto packed = encode_ids(ids.data(), ids.size());
+  if (packed.size() >= nbytes)
+    return 0;
+  void *out = H5allocate_memory(packed.size(), false);
+  if (!out)
+    return 0;
+  std::memcpy(out, packed.data(), packed.size());
+  H5free_memory(*buf);
+  *buf      = out;
+  *buf_size = packed.size();
+  return packed.size();
+}
+
+// registers the filter once per process, needed for writing and for reading coded datasets
+inline bool register_id_codec() {
+  static const bool registered = [] {
+    H5Z_class2_t cls{};
+    cls.version         = H5Z_CLASS_T_VERS;
+    cls.id              = id_codec_filter;
+    cls.encoder_present = 1;
+    cls.decoder_present = 1;
+    cls.name            = "delta-zigzag-bitpack uint64 IDs";
+    cls.filter          = id_codec_apply;
+    return H5Zregister(&cls) >= 0;
+  }();
+  return registered;
+}
+
+// the ID columns the codec is meant for
+inline bool is_id_column(const std::string &name) {
+  return name == "ParticleIDs" || name == "ParentID" || name == "TracerID";
+}
+
+// Creation properties of a dataset with `dims`: chunks of id_codec_chunk_rows rows through the
+// filter when `enabled`, else the default contiguous layout. Empty datasets stay contiguous.
+inline H5::DSetCreatPropList id_codec_dcpl(bool enabled, const std::vector<hsize_t> &dims) {
+  H5::DSetCreatPropList dcpl;
+  if (!enabled || dims.empty() || dims[0] == 0)
+    return dcpl;
+  register_id_codec();
+  auto chunk = dims;
+  chunk[0]   = std::min(dims[0], id_codec_chunk_rows);
+  dcpl.setChunk(static_cast<int>(chunk.size()), chunk.data());
+  H5Pset_filter(dcpl.getId(), id_codec_filter, H5Z_FLAG_OPTIONAL, 0, nullptr);
+  return dcpl;
+}
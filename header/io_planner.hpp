@@ -0,0 +1,84 @@
+#pragma once
+
+#include "io_stats.hpp"
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+// How one dataset is moved between the file and the island's ranks.
+enum class io_strategy : int { serial_scatter = 0, collective, independent };
+
+inline const char *io_strategy_name(io_strategy s) {
+  switch (s) {
+    case io_strategy::serial_scatter:
+      return "serial_scatter";
+    case io_strategy::collective:
+      return "collective";
+    case io_strategy::independent:
+      return "independent";
+  }
+  return "unknown";
+}
+
+// Runtime per-dataset choice used by the ADAPTIVE_IO builds. Small datasets are read by island
+// rank 0 and scattered (gathered and written for output), since a collective call costs more in
+// synchronisation than it moves. Mid-sized ones use two-phase collective I/O; once every rank's
+// share is large and contiguous, independent I/O skips the aggregation shuffle.
+struct io_planner {
+  // total dataset size below which serial_scatter is used
+  std::uint64_t serial_max_bytes{1ull << 20};
+  // per-rank share from which independent I/O is used
+  std::uint64_t independent_min_bytes{64ull << 20};
+
+  struct decision {
+    std::uint64_t bytes{0};
+    int ranks{0};
+    io_strategy strategy{io_strategy::collective};
+  };
+
+  // keyed "<op> <PartType>/<dataset>" like io_stats_registry, last decision wins
+  std::map<std::string, decision> decisions{};
+  std::vector<std::string> order{};
+
+  // must give the same answer on every rank of the island, so only depends on global sizes
+  io_strategy choose(io_op op, const std::string &dataset, std::uint64_t bytes, int ranks) {
+    io_strategy s = io_strategy::collective;
+    if (ranks == 1 || bytes < serial_max_bytes)
+      s = io_strategy::serial_scatter;
+    else if (bytes / static_cast<std::uint64_t>(ranks) >= independent_min_bytes)
+      s = io_strategy::independent;
+
+    auto key            = fmt::format("{} {}/{}", io_op_name(op), global_io_stats().group, dataset);
+    auto [it, inserted] = decisions.try_emplace(key);
+    if (inserted)
+      order.push_back(key);
+    it->second = {bytes, ranks, s};
+    return s;
+  }
+
+  void clear() {
+    decisions.clear();
+    order.clear();
+  }
+
+  void print() const {
+    fmt::print("I/O plan: serial_scatter below {:.3f} MiB, independent from {:.3f} MiB per rank\n",
+               serial_max_bytes / (1024.0 * 1024.0), independent_min_bytes / (1024.0 * 1024.0));
+    fmt::print("{:<6s} {:<40s} {:>12s} {:>6s} {:<16s}\n", "op", "dataset", "MiB", "ranks",
+               "strategy");
+    for (auto const &key : order) {
+      auto const &d = decisions.at(key);
+      auto sep      = key.find(' ');
+      fmt::print("{:<6s} {:<40s} {:>12.4f} {:>6d} {:<16s}\n", key.substr(0, sep),
+                 key.substr(sep + 1), d.bytes / (1024.0 * 1024.0), d.ranks,
+                 io_strategy_name(d.strategy));
+    }
+  }
+};
+
+inline io_planner &global_io_planner() {
+  static io_planner planner;
+  return planner;
+}
@@ -0,0 +1,210 @@
+#pragma once
+
+#include "timer_registry.hpp"
+#include "mpi_helpers.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <filesystem>
+#include <map>
+#include <mutex>
+#include <numeric>
+#include <string>
+#include <vector>
+
+enum class io_op : int { read = 0, scatter, gather, write };
+
+inline const char *io_op_name(io_op op) {
+  switch (op) {
+    case io_op::read:
+      return "read";
+    case io_op::scatter:
+      return "scatter";
+    case io_op::gather:
+      return "gather";
+    case io_op::write:
+      return "write";
+  }
+  return "unknown";
+}
+
+// bytes moved by this rank and the time it took
+struct io_sample {
+  std::uint64_t bytes{0};
+  double seconds{0.0};
+  std::size_t calls{0};
+};
+
+// Per dataset and operation byte/time counters, keyed "<op> <PartType>/<dataset>".
+struct io_stats_registry {
+  // PartType currently processed, set by io_group_scope
+  std::string group{};
+  std::map<std::string, io_sample> samples{};
+  std::vector<std::string> order{};
+
+  void add(io_op op, const std::string &dataset, std::uint64_t bytes, double seconds) {
+    add(op, group, dataset, bytes, seconds);
+  }
+
+  // explicit PartType, and safe to call from write_behind's helper thread
+  void add(io_op op, const std::string &group_, const std::string &dataset, std::uint64_t bytes,
+           double seconds) {
+    auto key = fmt::format("{} {}/{}", io_op_name(op), group_, dataset);
+    std::lock_guard<std::mutex> lock(add_mutex());
+    auto [it, inserted] = samples.try_emplace(key);
+    if (inserted)
+      order.push_back(key);
+    it->second.bytes += bytes;
+    it->second.seconds += seconds;
+    ++it->second.calls;
+  }
+
+  double total_seconds() const {
+    double total = 0.0;
+    for (auto const &[key, s] : samples) {
+      total += s.seconds;
+    }
+    return total;
+  }
+
+  std::uint64_t total_bytes() const {
+    std::uint64_t total = 0;
+    for (auto const &[key, s] : samples) {
+      total += s.bytes;
+    }
+    return total;
+  }
+
+  void clear() {
+    samples.clear();
+    order.clear();
+  }
+
+  static std::mutex &add_mutex() {
+    static std::mutex m;
+    return m;
+  }
+};
+
+inline io_stats_registry &global_io_stats() {
+  static io_stats_registry reg;
+  return reg;
+}
+
+struct io_group_scope {
+  std::string previous;
+
+  explicit io_group_scope(const std::string &group) : previous(global_io_stats().group) {
+    global_io_stats().group = group;
+  }
+
+  ~io_group_scope() { global_io_stats().group = previous; }
+};
+
+// times one dataset operation, set `bytes` before it goes out of scope
+struct io_timer {
+  io_op op;
+  const std::string &dataset;
+  std::uint64_t bytes{0};
+  double start{MPI_Wtime()};
+
+  io_timer(io_op op_, const std::string &dataset_) : op(op_), dataset(dataset_) {}
+
+  io_timer(const io_timer &)            = delete;
+  io_timer &operator=(const io_timer &) = delete;
+
+  ~io_timer() { global_io_stats().add(op, dataset, bytes, MPI_Wtime() - start); }
+};
+
+// Collective over comm. Aggregate bandwidth is all bytes over the slowest rank's time.
+inline void print_dataset_bandwidth(const io_stats_registry &stats, const mpicpp::comm &comm) {
+  auto names  = union_of_names(stats.order, comm);
+  const int n = static_cast<int>(names.size());
+  std::vector<std::uint64_t> bytes(n, 0);
+  std::vector<double> max_s(n, 0.0), sum_s(2 * n, 0.0);  // seconds followed by rank counts
+  for (int i = 0; i < n; ++i) {
+    auto it = stats.samples.find(names[i]);
+    if (it == stats.samples.end())
+      continue;
+    bytes[i] = it->second.bytes;
+    max_s[i] = sum_s[i] = it->second.seconds;
+    sum_s[n + i]        = 1.0;
+  }
+  const bool root = comm.rank() == 0;
+  MPI_Reduce(root ? MPI_IN_PLACE : bytes.data(), bytes.data(), n, MPI_UINT64_T, MPI_SUM, 0,
+             comm.get());
+  MPI_Reduce(root ? MPI_IN_PLACE : max_s.data(), max_s.data(), n, MPI_DOUBLE, MPI_MAX, 0,
+             comm.get());
+  MPI_Reduce(root ? MPI_IN_PLACE : sum_s.data(), sum_s.data(), 2 * n, MPI_DOUBLE, MPI_SUM, 0,
+             comm.get());
+  if (!root)
+    return;
+
+  fmt::print("{:<8s} {:<40s} {:>10s} {:>10s} {:>10s} {:>10s} {:>6s}\n", "op", "dataset", "GiB",
+             "max_s", "avg_s", "GB/s", "ranks");
+  for (int i = 0; i < n; ++i) {
+    auto sep         = names[i].find(' ');
+    const int ranks  = static_cast<int>(sum_s[n + i]);
+    const double gib = static_cast<double>(bytes[i]) / (1024.0 * 1024.0 * 1024.0);
+    const double bw  = max_s[i] > 0.0 ? static_cast<double>(bytes[i]) / max_s[i] / 1e9 : 0.0;
+    fmt::print("{:<8s} {:<40s} {:>10.4f} {:>10.4f} {:>10.4f} {:>10.3f} {:>6d}\n",
+               names[i].substr(0, sep), names[i].substr(sep + 1), gib, max_s[i],
+               sum_s[i] / ranks, bw, ranks);
+  }
+}
+
+// Collective over world_comm. Per island spread of the time ranks spent in dataset I/O,
+// followed by the `top` slowest ranks and the hosts they ran on.
+inline void print_rank_imbalance(const io_stats_registry &stats, const mpi_state &state,
+                                 int top = 5) {
+  constexpr int desc_len = 160;
+  double mine[3]         = {stats.total_seconds(), static_cast<double>(stats.total_bytes()),
+                            static_cast<double>(state.i_color)};
+  std::string desc       = fmt::format("{}| on host {}", state.describe(), mpi_state::host_name());
+  desc.resize(desc_len, '\0');
+
+  const bool root = state.w_rank == 0;
+  std::vector<double> all(root ? 3 * state.w_size : 0);
+  std::string all_desc(root ? desc_len * state.w_size : 0, '\0');
+  MPI_Gather(mine, 3, MPI_DOUBLE, all.data(), 3, MPI_DOUBLE, 0, state.world_comm.get());
+  MPI_Gather(desc.data(), desc_len, MPI_CHAR, all_desc.data(), desc_len, MPI_CHAR, 0,
+             state.world_comm.get());
+  if (!root)
+    return;
+
+  struct island_spread {
+    double min{1e300}, max{0.0}, sum{0.0};
+    int ranks{0}, slowest{-1};
+  };
+  std::map<int, island_spread> islands;
+  for (int r = 0; r < state.w_size; ++r) {
+    const double t = all[3 * r];
+    auto &isl      = islands[static_cast<int>(all[3 * r + 2])];
+    isl.min        = std::min(isl.min, t);
+    isl.sum += t;
+    ++isl.ranks;
+    if (t >= isl.max) {
+      isl.max     = t;
+      isl.slowest = r;
+    }
+  }
+
+  fmt::print("{:>6s} {:>6s} {:>10s} {:>10s} {:>10s} {:>9s} {:>8s}\n", "island", "ranks", "min_s",
+             "avg_s", "max_s", "max/avg", "slowest");
+  for (auto const &[colour, isl] : islands) {
+    const double avg = isl.sum / isl.ranks;
+    fmt::print("{:>6d} {:>6d} {:>10.4f} {:>10.4f} {:>10.4f} {:>9.3f} {:>8d}\n", colour, isl.ranks,
+               isl.min, avg, isl.max, avg > 0.0 ? isl.max / avg : 1.0, isl.slowest);
+  }
+
+  std::vector<int> ranks(state.w_size);
+  std::iota(ranks.begin(), ranks.end(), 0);
+  std::sort(ranks.begin(), ranks.end(), [&](int a, int b) { return all[3 * a] > all[3 * b]; });
+  fmt::print("slowest ranks by dataset I/O time:\n");
+  for (int i = 0; i < std::min(top, state.w_size); ++i) {
+    const int r = ranks[i];
+    fmt::print("  {:10.4f} s {:10.4f} GiB | {}\n", all[3 * r],
+               all[3 * r + 1] / (1024.0 * 1024.0 * 1024.0),
+               all_desc.substr(static_cast<std::size_t>(r) * desc_len, desc_len).c_str());
+  }
+}
@@ -0,0 +1,171 @@
+#pragma once
+
+#include <H5Cpp.h>
+#include <fmt/format.h>
+#include <mpi.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Offset-level trace of HDF5 and MPI-IO calls, compiled in with -DIO_TRACE.
+// Every rank appends fixed-size records to $IO_TRACE_DIR/io_trace.<world rank>.bin
+// (default: current directory), io_trace_merge turns them into histograms and a timeline.
+
+enum class trace_layer : std::uint8_t { hdf5 = 0, mpiio };
+enum class trace_op : std::uint8_t { read = 0, write, attr_read, attr_write };
+// serial: no MPI transfer property involved, e.g. files opened by one rank and attribute access
+enum class trace_mode : std::uint8_t { serial = 0, independent, collective };
+
+inline trace_mode trace_mode_of(H5FD_mpio_xfer_t xfer) {
+  return xfer == H5FD_MPIO_COLLECTIVE ? trace_mode::collective : trace_mode::independent;
+}
+
+// set when `offset` is an absolute file address, otherwise it is relative to the dataset start
+constexpr std::uint8_t trace_offset_absolute = 1;
+
+// Timestamps of every record, in seconds. Not MPI_Wtime: write_behind's helper thread records
+// its HDF5 writes too and must not call MPI.
+inline double trace_clock() {
+  const std::chrono::duration<double> t = std::chrono::system_clock::now().time_since_epoch();
+  return t.count();
+}
+
+struct trace_record {
+  double t_start;
+  double t_stop;
+  std::uint64_t offset;
+  std::uint64_t size;
+  std::int32_t rank;
+  trace_layer layer;
+  trace_op op;
+  trace_mode mode;
+  std::uint8_t flags;
+  char file[40];
+  char object[64];
+};
+
+constexpr char trace_magic[8] = {'I', 'O', 'T', 'R', 'A', 'C', 'E', '1'};
+
+inline void copy_name(char *dst, std::size_t len, const std::string &src) {
+  // keep the tail, file names and dataset paths differ at the end
+  const std::size_t n = std::min(src.size(), len - 1);
+  std::memcpy(dst, src.data() + src.size() - n, n);
+  std::memset(dst + n, 0, len - n);
+}
+
+struct io_trace_log {
+  std::vector<trace_record> records{};
+  // file names of the MPI-IO handles opened through the PMPI wrappers
+  std::map<MPI_File, std::string> files{};
+  int rank{-1};
+  bool flushed_once{false};
+  std::mutex mutex{};
+
+  static constexpr std::size_t flush_every = 1 << 16;
+
+  // may run on write_behind's helper thread, which must not call MPI: rank is looked up by the
+  // first record, always written from the main thread
+  void add(const trace_record &rec) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (rank < 0) {
+      MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    }
+    records.push_back(rec);
+    records.back().rank = rank;
+    if (records.size() >= flush_every)
+      flush();
+  }
+
+  std::string path() const {
+    const char *dir = std::getenv("IO_TRACE_DIR");
+    return fmt::format("{}/io_trace.{}.bin", dir ? dir : ".", rank);
+  }
+
+  void flush() {
+    if (rank < 0 || (records.empty() && flushed_once))
+      return;
+    std::ofstream out(path(), flushed_once ? std::ios::binary | std::ios::app
+                                           : std::ios::binary | std::ios::trunc);
+    if (!flushed_once) {
+      const std::uint32_t rec_size = sizeof(trace_record);
+      out.write(trace_magic, sizeof(trace_magic));
+      out.write(reinterpret_cast<const char *>(&rec_size), sizeof(rec_size));
+      flushed_once = true;
+    }
+    out.write(reinterpret_cast<const char *>(records.data()),
+              static_cast<std::streamsize>(records.size() * sizeof(trace_record)));
+    records.clear();
+  }
+
+  // runs after MPI_Finalize, only touches the local file system
+  ~io_trace_log() { flush(); }
+};
+
+inline io_trace_log &global_io_trace() {
+  static io_trace_log log;
+  return log;
+}
+
+#ifdef IO_TRACE
+
+// Records one HDF5 call on `obj` (a dataset, or the owner of attribute `attr`).
+// Names and the file address are looked up after the call, when storage is allocated.
+struct hdf5_trace_scope {
+  trace_record rec{};
+  hid_t obj;
+  const char *attr;
+
+  hdf5_trace_scope(trace_op op, trace_mode mode, hid_t obj_, std::uint64_t rel_offset,
+                   std::uint64_t size, const char *attr_ = nullptr)
+      : obj(obj_), attr(attr_) {
+    rec.layer   = trace_layer::hdf5;
+    rec.op      = op;
+    rec.mode    = mode;
+    rec.offset  = rel_offset;
+    rec.size    = size;
+    rec.t_start = trace_clock();
+  }
+
+  hdf5_trace_scope(const hdf5_trace_scope &)            = delete;
+  hdf5_trace_scope &operator=(const hdf5_trace_scope &) = delete;
+
+  ~hdf5_trace_scope() {
+    rec.t_stop = trace_clock();
+    char buf[256];
+    std::string file, object;
+    if (H5Fget_name(obj, buf, sizeof(buf)) > 0)
+      file = std::filesystem::path(buf).filename().string();
+    if (H5Iget_name(obj, buf, sizeof(buf)) > 0)
+      object = buf;
+    if (attr)
+      object = object + "@" + attr;
+    else if (H5Iget_type(obj) == H5I_DATASET) {
+      const haddr_t base = H5Dget_offset(obj);  // undefined for chunked or unallocated data
+      if (base != HADDR_UNDEF) {
+        rec.offset += base;
+        rec.flags |= trace_offset_absolute;
+      }
+    }
+    copy_name(rec.file, sizeof(rec.file), file);
+    copy_name(rec.object, sizeof(rec.object), object);
+    global_io_trace().add(rec);
+  }
+};
+
+#else
+
+struct hdf5_trace_scope {
+  hdf5_trace_scope(trace_op, trace_mode, hid_t, std::uint64_t, std::uint64_t,
+                   const char * = nullptr) {}
+};
+
+#endif
@@ -0,0 +1,102 @@
+#pragma once
+
+// PMPI wrappers recording the MPI-IO calls HDF5 issues underneath. They define the MPI_File_*
+// symbols, so include this from exactly one translation unit, the program's main.cpp.
+// Offsets are view displacement + offset * etype size; with the derived filetypes HDF5 sets for
+// collective hyperslab access that is the start of the access, `size` is the bytes moved.
+
+#include "io_trace.hpp"
+
+#ifdef IO_TRACE
+
+namespace io_trace_detail {
+
+// `offset` counts etypes relative to the current view
+inline void record(trace_op op, trace_mode mode, MPI_File fh, MPI_Offset offset, int count,
+                   MPI_Datatype type, double t_start) {
+  trace_record rec{};
+  rec.t_stop  = trace_clock();
+  rec.t_start = t_start;
+  rec.layer   = trace_layer::mpiio;
+  rec.op      = op;
+  rec.mode    = mode;
+  rec.flags   = trace_offset_absolute;
+
+  MPI_Offset disp;
+  MPI_Datatype etype, filetype;
+  char datarep[MPI_MAX_DATAREP_STRING];
+  PMPI_File_get_view(fh, &disp, &etype, &filetype, datarep);
+  int etype_size = 1, type_size = 0;
+  PMPI_Type_size(etype, &etype_size);
+  PMPI_Type_size(type, &type_size);
+  for (auto t : {&etype, &filetype}) {
+    // get_view hands out copies of derived types
+    int ni, na, nd, combiner;
+    PMPI_Type_get_envelope(*t, &ni, &na, &nd, &combiner);
+    if (combiner != MPI_COMBINER_NAMED)
+      PMPI_Type_free(t);
+  }
+  rec.offset = static_cast<std::uint64_t>(disp + offset * etype_size);
+  rec.size   = static_cast<std::uint64_t>(count) * static_cast<std::uint64_t>(type_size);
+
+  auto &log = global_io_trace();
+  if (auto it = log.files.find(fh); it != log.files.end())
+    copy_name(rec.file, sizeof(rec.file), it->second);
+  log.add(rec);
+}
+
+}  // namespace io_trace_detail
+
+extern "C" {
+
+int MPI_File_open(MPI_Comm comm, const char *filename, int amode, MPI_Info info, MPI_File *fh) {
+  const int err = PMPI_File_open(comm, filename, amode, info, fh);
+  if (err == MPI_SUCCESS)
+    global_io_trace().files[*fh] = std::filesystem::path(filename).filename().string();
+  return err;
+}
+
+int MPI_File_close(MPI_File *fh) {
+  global_io_trace().files.erase(*fh);
+  return PMPI_File_close(fh);
+}
+
+int MPI_File_read_at(MPI_File fh, MPI_Offset offset, void *buf, int count, MPI_Datatype datatype,
+                     MPI_Status *status) {
+  const double t0 = trace_clock();
+  const int err   = PMPI_File_read_at(fh, offset, buf, count, datatype, status);
+  io_trace_detail::record(trace_op::read, trace_mode::independent, fh, offset, count, datatype,
+                          t0);
+  return err;
+}
+
+int MPI_File_read_at_all(MPI_File fh, MPI_Offset offset, void *buf, int count,
+                         MPI_Datatype datatype, MPI_Status *status) {
+  const double t0 = trace_clock();
+  const int err   = PMPI_File_read_at_all(fh, offset, buf, count, datatype, status);
+  io_trace_detail::record(trace_op::read, trace_mode::collective, fh, offset, count, datatype,
+                          t0);
+  return err;
+}
+
+int MPI_File_write_at(MPI_File fh, MPI_Offset offset, const void *buf, int count,
+                      MPI_Datatype datatype, MPI_Status *status) {
+  const double t0 = trace_clock();
+  const int err   = PMPI_File_write_at(fh, offset, buf, count, datatype, status);
+  io_trace_detail::record(trace_op::write, trace_mode::independent, fh, offset, count, datatype,
+                          t0);
+  return err;
+}
+
+int MPI_File_write_at_all(MPI_File fh, MPI_Offset offset, const void *buf, int count,
+                          MPI_Datatype datatype, MPI_Status *status) {
+  const double t0 = trace_clock();
+  const int err   = PMPI_File_write_at_all(fh, offset, buf, count, datatype, status);
+  io_trace_detail::record(trace_op::write, trace_mode::collective, fh, offset, count, datatype,
+                          t0);
+  return err;
+}
+
+}  // extern "C"
+
+#endif
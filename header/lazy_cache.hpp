@@ -0,0 +1,72 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <list>
+#include <unordered_map>
+
+// --lazy: datasets that were read on first use and not modified since, most recently used
+// first. Once their bytes exceed the budget the least recently used ones are evicted and read
+// again on their next use. Every island rank makes the same calls in the same order with
+// whole-dataset sizes, so all ranks evict the same datasets without talking to each other.
+struct lazy_cache {
+  struct entry {
+    const void *owner;
+    std::size_t bytes;
+    std::function<void()> evict;
+  };
+
+  // bytes of clean datasets kept resident, 0 for no limit
+  std::size_t budget{0};
+  std::size_t resident{0};
+  std::size_t peak{0};
+  std::size_t loads{0};
+  std::size_t evictions{0};
+  std::list<entry> lru{};
+  std::unordered_map<const void *, std::list<entry>::iterator> where{};
+
+  // `owner` is in use: it moves to the front, evicting others while over budget
+  void touch(const void *owner, std::size_t bytes, std::function<void()> evict) {
+    auto it = where.find(owner);
+    if (it != where.end()) {
+      lru.splice(lru.begin(), lru, it->second);
+    } else {
+      lru.push_front({owner, bytes, std::move(evict)});
+      where[owner] = lru.begin();
+      resident += bytes;
+      ++loads;
+    }
+    while (budget > 0 && resident > budget && lru.back().owner != owner) {
+      auto victim = std::move(lru.back());
+      lru.pop_back();
+      where.erase(victim.owner);
+      resident -= victim.bytes;
+      ++evictions;
+      victim.evict();
+    }
+    if (resident > peak)
+      peak = resident;
+  }
+
+  // `owner` leaves the cache without being evicted: modified or destroyed
+  void forget(const void *owner) {
+    auto it = where.find(owner);
+    if (it == where.end())
+      return;
+    resident -= it->second->bytes;
+    lru.erase(it->second);
+    where.erase(it);
+  }
+
+  // counters only, resident datasets stay
+  void clear() {
+    loads     = 0;
+    evictions = 0;
+    peak      = resident;
+  }
+};
+
+inline lazy_cache &global_lazy_cache() {
+  static lazy_cache cache;
+  return cache;
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <H5Cpp.h>
+#include <fcntl.h>
+#include <fmt/format.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+// Read-only mapping of `bytes` at byte `offset` of a file. The pages are faulted in from the
+// page cache on first touch, nothing is copied up front. The descriptor is closed right away,
+// the mapping stays valid until destruction.
+struct mapped_range {
+  void *addr{MAP_FAILED};
+  std::size_t length{0};
+  std::size_t skip{0};
+
+  mapped_range(const std::string &path, std::uint64_t offset, std::size_t bytes) {
+    const auto page  = static_cast<std::uint64_t>(sysconf(_SC_PAGESIZE));
+    const auto start = offset - offset % page;
+    skip             = static_cast<std::size_t>(offset - start);
+    length           = skip + bytes;
+    const int fd     = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+      throw std::runtime_error(fmt::format("mapped_range: open {}: {}", path, std::strerror(errno)));
+    addr            = mmap(nullptr, length, PROT_READ, MAP_SHARED, fd, static_cast<off_t>(start));
+    const int error = errno;
+    close(fd);
+    if (addr == MAP_FAILED)
+      throw std::runtime_error(fmt::format("mapped_range: mmap {}: {}", path, std::strerror(error)));
+  }
+
+  mapped_range(const mapped_range &)            = delete;
+  mapped_range &operator=(const mapped_range &) = delete;
+
+  ~mapped_range() {
+    if (addr != MAP_FAILED)
+      munmap(addr, length);
+  }
+
+  const void *data() const { return static_cast<const char *>(addr) + skip; }
+};
+
+// Byte offset of the raw data of `ds` in its file, HADDR_UNDEF unless the bytes on disk are
+// exactly what a read into `mem_type` would produce: contiguous layout, no filters or external
+// storage, same type as in memory, little-endian host, plain POSIX file driver.
+inline haddr_t raw_file_offset(const H5::DataSet &ds, const H5::DataType &mem_type) {
+  if (H5Tget_order(H5T_NATIVE_INT) != H5T_ORDER_LE)
+    return HADDR_UNDEF;
+  auto dcpl = ds.getCreatePlist();
+  if (dcpl.getLayout() != H5D_CONTIGUOUS || dcpl.getNfilters() != 0 ||
+      dcpl.getExternalCount() != 0)
+    return HADDR_UNDEF;
+  if (!(ds.getDataType() == mem_type))
+    return HADDR_UNDEF;
+  const hid_t file = H5Iget_file_id(ds.getId());
+  const hid_t fapl = H5Fget_access_plist(file);
+  const hid_t fcpl = H5Fget_create_plist(file);
+  hsize_t userblock = 0;
+  H5Pget_userblock(fcpl, &userblock);
+  const bool posix = H5Pget_driver(fapl) == H5FD_SEC2;
+  H5Pclose(fcpl);
+  H5Pclose(fapl);
+  H5Fclose(file);
+  const haddr_t addr = H5Dget_offset(ds.getId());
+  if (!posix || addr == HADDR_UNDEF)
+    return HADDR_UNDEF;
+  // addresses are relative to the superblock, which follows the user block
+  return addr + userblock;
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <unistd.h>
+
+#include <cstddef>
+#include <fstream>
+#include <string>
+#include <unordered_map>
+
+// Memory probes behind the benchmark's --memory, read from /proc; 0 where that is unavailable.
+
+// resident set size now
+inline std::size_t current_rss_bytes() {
+  std::ifstream statm("/proc/self/statm");
+  std::size_t pages = 0, resident = 0;
+  if (!(statm >> pages >> resident))
+    return 0;
+  return resident * static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+}
+
+// largest resident set size since the process started or the last reset_peak_rss()
+inline std::size_t peak_rss_bytes() {
+  std::ifstream status("/proc/self/status");
+  for (std::string line; std::getline(status, line);) {
+    if (line.rfind("VmHWM:", 0) == 0)
+      return std::stoull(line.substr(6)) * 1024;
+  }
+  return 0;
+}
+
+// restarts the peak at the current resident set size (Linux >= 4.0), false if not permitted
+inline bool reset_peak_rss() {
+  std::ofstream clear_refs("/proc/self/clear_refs");
+  clear_refs << "5";
+  clear_refs.flush();
+  return clear_refs.good();
+}
+
+// Bytes held in the particle buffers of this rank: the data_chunk capacity of every live
+// dataset_data. Views of shared or mapped memory and buffers handed to the write-behind
+// thread are not included.
+struct buffer_registry {
+  using probe = std::size_t (*)(const void *);
+  std::unordered_map<const void *, probe> live{};
+
+  void add(const void *owner, probe bytes_of) { live[owner] = bytes_of; }
+
+  void remove(const void *owner) { live.erase(owner); }
+
+  std::size_t bytes() const {
+    std::size_t total = 0;
+    for (auto const &[owner, bytes_of] : live)
+      total += bytes_of(owner);
+    return total;
+  }
+};
+
+inline buffer_registry &global_buffers() {
+  static buffer_registry reg;
+  return reg;
+}
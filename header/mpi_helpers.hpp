@@ -1,10 +1,12 @@
 #pragma once
 
+#include <algorithm>
 #include <string>
 #include <fmt/format.h>
 #include <mpi.h>
 #include <unistd.h>
 #include <utility>
+#include <vector>
 
 int get_island_colour(int w_rank, int w_size, int numfiles)
 {
@@ -57,6 +59,21 @@ std::vector<VT> distribute_data(std::vector<VT> &g_data, const mpicpp::comm &isl
   return local_data;
 }
 
+// MPI_Init_thread asking for `required`; `provided` is what the library grants. Used instead of
+// mpicpp::environment, which initializes without a thread level.
+struct mpi_environment
+{
+  int provided{MPI_THREAD_SINGLE};
+  mpi_environment(int *argc, char ***argv, int required)
+  {
+    MPI_Init_thread(argc, argv, required, &provided);
+  }
+  mpi_environment(const mpi_environment &) = delete;
+  mpi_environment &operator=(const mpi_environment &) = delete;
+  ~mpi_environment() { MPI_Finalize(); }
+  bool grants(int level) const { return provided >= level; }
+};
+
 struct mpi_state
 {
   mpicpp::comm island_comm;
@@ -66,47 +83,74 @@ struct mpi_state
   int i_size{-1};
   int w_rank{-1};
   int w_size{-1};
+  int num_files{-1};
+  // min(w_size, numfiles), island `i` owns files i, i + num_islands, ...
+  int num_islands{-1};
+  // this island's queue of file indices, processed one after another
+  std::vector<int> files;
+  // the file of `files` currently being processed, selects the file handles
+  int i_file{-1};
   mpi_state(int numfiles)
   {
     world_comm = mpicpp::comm::world();
     w_rank = world_comm.rank();
     w_size = world_comm.size();
-    i_color = get_island_colour(w_rank, w_size, numfiles);
+    state_check(numfiles);
+    num_files = numfiles;
+    num_islands = std::min(w_size, numfiles);
+    i_color = get_island_colour(w_rank, w_size, num_islands);
     island_comm = world_comm.split(i_color, w_rank);
     i_rank = island_comm.rank();
     i_size = island_comm.size();
-    state_check(numfiles);
+    for (int f = i_color; f < numfiles; f += num_islands)
+    {
+      files.push_back(f);
+    }
+    i_file = files.front();
+  }
+  // every island's queue has the same length, so world-wide barriers between files match up
+  bool uniform_queues() const
+  {
+    return num_files % num_islands == 0;
+  }
+  static std::string host_name()
+  {
+    char name[256];
+    gethostname(name, sizeof(name));
+    return name;
+  }
+  std::string describe() const
+  {
+    return fmt::format("W_rank {:^3d}/{:^3d}|I_rank {:^3d}/{:^3d}| i_colour {:^3d}| files {:^3d}", w_rank, w_size - 1, i_rank, i_size - 1, i_color, files.size());
   }
   void print(const std::filesystem::path &fname = "")
   {
-    fmt::print("W_rank {:^3d}/{:^3d}|I_rank {:^3d}/{:^3d}| i_colour {:^3d}", w_rank, w_size - 1, i_rank, i_size - 1, i_color);
+    fmt::print("{}", describe());
     if (fname.empty())
     {
       fmt::print("\n");
     }
     else
     {
-      char host_name[256];
-      gethostname(host_name, sizeof(host_name));
       // Get the parent directory name + filename
       std::string result = fname.parent_path().filename().string() + "/" + fname.filename().string();
-      fmt::print("| on host {} | will handle {} \n", host_name, result);
+      fmt::print("| on host {} | will handle {} \n", host_name(), result);
     }
   }
   void print_stats()
   {
     if (i_rank == 0)
     {
-      fmt::print("Island {:^3d} has {:^3d} ranks per island \n", i_color, i_size);
+      fmt::print("Island {:^3d} has {:^3d} ranks per island and {:^3d} files \n", i_color, i_size, files.size());
     }
   }
 
 private:
   void state_check(int numfiles)
   {
-    if (w_size < numfiles)
+    if (numfiles < 1)
     {
-      throw std::runtime_error(fmt::format("Number of MPI ranks ({}) is less than number of files ({}). Exiting...", w_size, numfiles));
+      throw std::runtime_error(fmt::format("Number of files ({}) must be positive. Exiting...", numfiles));
     }
   }
 };
\ No newline at end of file
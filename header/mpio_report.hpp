@@ -0,0 +1,167 @@
+#pragma once
+
+#include "io_stats.hpp"
+
+#include <H5Cpp.h>
+
+#include <array>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+// What HDF5 really did for a transfer with the MPI-IO driver, read back from the transfer
+// property list after the call. A collective request can silently end up independent.
+inline constexpr std::array<std::pair<std::uint32_t, const char *>, 8> no_collective_causes{{
+  {H5D_MPIO_SET_INDEPENDENT, "set_independent"},
+  {H5D_MPIO_DATATYPE_CONVERSION, "datatype_conversion"},
+  {H5D_MPIO_DATA_TRANSFORMS, "data_transforms"},
+  {H5D_MPIO_MPI_OPT_TYPES_ENV_VAR_DISABLED, "mpi_opt_types_disabled"},
+  {H5D_MPIO_NOT_SIMPLE_OR_SCALAR_DATASPACES, "not_simple_or_scalar_dataspace"},
+  {H5D_MPIO_NOT_CONTIGUOUS_OR_CHUNKED_DATASET, "not_contiguous_or_chunked"},
+  {H5D_MPIO_PARALLEL_FILTERED_WRITES_DISABLED, "filtered_writes_disabled"},
+  {H5D_MPIO_ERROR_WHILE_CHECKING_COLLECTIVE_POSSIBLE, "error_checking_collective"},
+}};
+
+inline std::string describe_causes(std::uint32_t causes) {
+  std::string out;
+  for (auto const &[bit, label] : no_collective_causes) {
+    if (causes & bit)
+      out += out.empty() ? label : fmt::format("|{}", label);
+  }
+  return out.empty() ? "-" : out;
+}
+
+// Counters of one dataset operation on this rank. The actual I/O mode is one of
+// no_collective, chunk_independent, chunk_collective, chunk_mixed, contiguous_collective.
+struct mpio_sample {
+  std::uint64_t calls{0};
+  std::uint64_t requested_collective{0};
+  // requested collective but HDF5 did no collective I/O at all
+  std::uint64_t fallbacks{0};
+  std::array<std::uint64_t, 5> io_modes{};
+  // no_chunk_optimization, link_chunk, multi_chunk
+  std::array<std::uint64_t, 3> chunk_opts{};
+  std::uint32_t local_causes{0};
+  std::uint32_t global_causes{0};
+};
+
+inline int io_mode_index(H5D_mpio_actual_io_mode_t mode) {
+  switch (mode) {
+    case H5D_MPIO_NO_COLLECTIVE:
+      return 0;
+    case H5D_MPIO_CHUNK_INDEPENDENT:
+      return 1;
+    case H5D_MPIO_CHUNK_COLLECTIVE:
+      return 2;
+    case H5D_MPIO_CHUNK_MIXED:
+      return 3;
+    case H5D_MPIO_CONTIGUOUS_COLLECTIVE:
+      return 4;
+  }
+  return 0;
+}
+
+// keyed "<op> <PartType>/<dataset>" like io_stats_registry
+struct mpio_report_registry {
+  std::map<std::string, mpio_sample> samples{};
+  std::vector<std::string> order{};
+
+  // call right after H5Dread/H5Dwrite with the transfer property list that was passed to it
+  void add(io_op op, const std::string &dataset, H5FD_mpio_xfer_t requested,
+           const H5::DSetMemXferPropList &xfer) {
+    H5D_mpio_actual_io_mode_t io_mode           = H5D_MPIO_NO_COLLECTIVE;
+    H5D_mpio_actual_chunk_opt_mode_t chunk_mode = H5D_MPIO_NO_CHUNK_OPTIMIZATION;
+    std::uint32_t local_cause = 0, global_cause = 0;
+    H5Pget_mpio_actual_io_mode(xfer.getId(), &io_mode);
+    H5Pget_mpio_actual_chunk_opt_mode(xfer.getId(), &chunk_mode);
+    H5Pget_mpio_no_collective_cause(xfer.getId(), &local_cause, &global_cause);
+
+    auto key            = fmt::format("{} {}/{}", io_op_name(op), global_io_stats().group, dataset);
+    auto [it, inserted] = samples.try_emplace(key);
+    if (inserted)
+      order.push_back(key);
+    auto &s = it->second;
+    ++s.calls;
+    ++s.io_modes[io_mode_index(io_mode)];
+    ++s.chunk_opts[static_cast<int>(chunk_mode)];
+    if (requested == H5FD_MPIO_COLLECTIVE) {
+      ++s.requested_collective;
+      if (io_mode == H5D_MPIO_NO_COLLECTIVE)
+        ++s.fallbacks;
+    }
+    s.local_causes |= local_cause;
+    s.global_causes |= global_cause;
+  }
+
+  std::uint64_t total_fallbacks() const {
+    std::uint64_t total = 0;
+    for (auto const &[key, s] : samples) {
+      total += s.fallbacks;
+    }
+    return total;
+  }
+
+  void clear() {
+    samples.clear();
+    order.clear();
+  }
+};
+
+inline mpio_report_registry &global_mpio_report() {
+  static mpio_report_registry reg;
+  return reg;
+}
+
+// Collective over comm: collective requests that fell back to independent, summed over ranks.
+inline std::uint64_t count_collective_fallbacks(const mpio_report_registry &reg,
+                                                const mpicpp::comm &comm) {
+  std::uint64_t mine = reg.total_fallbacks(), total = 0;
+  MPI_Allreduce(&mine, &total, 1, MPI_UINT64_T, MPI_SUM, comm.get());
+  return total;
+}
+
+// Collective over comm. Per dataset: calls summed over ranks, how many ran in each actual mode,
+// the chunk optimisation used and every local/global reason collective I/O was broken.
+inline void print_mpio_report(const mpio_report_registry &reg, const mpicpp::comm &comm) {
+  auto names  = union_of_names(reg.order, comm);
+  const int n = static_cast<int>(names.size());
+  constexpr int counters = 11;  // calls, requested, fallbacks, 5 io modes, 3 chunk opts
+  std::vector<std::uint64_t> counts(counters * n, 0);
+  std::vector<std::uint32_t> causes(2 * n, 0);
+  for (int i = 0; i < n; ++i) {
+    auto it = reg.samples.find(names[i]);
+    if (it == reg.samples.end())
+      continue;
+    auto const &s = it->second;
+    auto *c       = &counts[counters * i];
+    c[0]          = s.calls;
+    c[1]          = s.requested_collective;
+    c[2]          = s.fallbacks;
+    std::copy(s.io_modes.begin(), s.io_modes.end(), c + 3);
+    std::copy(s.chunk_opts.begin(), s.chunk_opts.end(), c + 8);
+    causes[2 * i]     = s.local_causes;
+    causes[2 * i + 1] = s.global_causes;
+  }
+  const bool root = comm.rank() == 0;
+  MPI_Reduce(root ? MPI_IN_PLACE : counts.data(), counts.data(), counters * n, MPI_UINT64_T,
+             MPI_SUM, 0, comm.get());
+  MPI_Reduce(root ? MPI_IN_PLACE : causes.data(), causes.data(), 2 * n, MPI_UINT32_T, MPI_BOR, 0,
+             comm.get());
+  if (!root || n == 0)
+    return;
+
+  fmt::print("{:<6s} {:<40s} {:>7s} {:>7s} {:>9s} {:>7s} {:>7s} {:>7s} {:>7s} {:>7s} {:>6s} {:>6s} "
+             "{:>6s}  {}\n",
+             "op", "dataset", "calls", "coll_rq", "fallback", "no_coll", "ch_ind", "ch_coll",
+             "ch_mix", "contig", "none", "link", "multi", "local/global causes");
+  for (int i = 0; i < n; ++i) {
+    auto sep      = names[i].find(' ');
+    const auto *c = &counts[counters * i];
+    fmt::print("{:<6s} {:<40s} {:>7d} {:>7d} {:>9d} {:>7d} {:>7d} {:>7d} {:>7d} {:>7d} {:>6d} "
+               "{:>6d} {:>6d}  {} / {}\n",
+               names[i].substr(0, sep), names[i].substr(sep + 1), c[0], c[1], c[2], c[3], c[4],
+               c[5], c[6], c[7], c[8], c[9], c[10], describe_causes(causes[2 * i]),
+               describe_causes(causes[2 * i + 1]));
+  }
+}
@@ -0,0 +1,237 @@
+#pragma once
+
+#include <mpi.h>
+#include <mpicpp.hpp>
+
+#include <numeric>
+#include <vector>
+
+// Two-level view of an island for the serial read/write modes: ranks sharing a node, plus one
+// leader per node. Island rank 0 is node rank 0 on its node and leader rank 0, so the root
+// sends one message per node instead of one per rank.
+struct node_topology {
+  MPI_Comm island{MPI_COMM_NULL};
+  MPI_Comm node{MPI_COMM_NULL};
+  // only valid on node leaders
+  MPI_Comm leaders{MPI_COMM_NULL};
+  int node_rank{-1};
+  int node_size{0};
+  int num_nodes{0};
+  // this node holds island rank 0
+  bool root_node{false};
+  // island ranks on this node in node rank order, valid on leaders
+  std::vector<int> members{};
+  // members of every node in leader order, valid on island rank 0
+  std::vector<std::vector<int>> nodes{};
+
+  explicit node_topology(const mpicpp::comm &island_comm)
+      : node_topology(island_comm, split_shared(island_comm)) {}
+
+  // takes ownership of `node_comm`, any split of the island works (e.g. per socket)
+  node_topology(const mpicpp::comm &island_comm, MPI_Comm node_comm)
+      : island(island_comm.get()), node(node_comm) {
+    int i_rank;
+    MPI_Comm_rank(island, &i_rank);
+    MPI_Comm_rank(node, &node_rank);
+    MPI_Comm_size(node, &node_size);
+    MPI_Comm_split(island, node_rank == 0 ? 0 : MPI_UNDEFINED, i_rank, &leaders);
+
+    int leader = i_rank;
+    MPI_Bcast(&leader, 1, MPI_INT, 0, node);
+    root_node = leader == 0;
+
+    members.resize(node_rank == 0 ? node_size : 0);
+    MPI_Gather(&i_rank, 1, MPI_INT, members.data(), 1, MPI_INT, 0, node);
+
+    if (leaders != MPI_COMM_NULL) {
+      MPI_Comm_size(leaders, &num_nodes);
+      std::vector<int> sizes(num_nodes), displs(num_nodes, 0), all;
+      MPI_Gather(&node_size, 1, MPI_INT, sizes.data(), 1, MPI_INT, 0, leaders);
+      std::partial_sum(sizes.begin(), sizes.end() - 1, displs.begin() + 1);
+      if (i_rank == 0)
+        all.resize(displs.back() + sizes.back());
+      MPI_Gatherv(members.data(), node_size, MPI_INT, all.data(), sizes.data(), displs.data(),
+                  MPI_INT, 0, leaders);
+      for (int n = 0; i_rank == 0 && n < num_nodes; ++n) {
+        nodes.emplace_back(all.begin() + displs[n], all.begin() + displs[n] + sizes[n]);
+      }
+    }
+    MPI_Bcast(&num_nodes, 1, MPI_INT, 0, island);
+  }
+
+  node_topology(const node_topology &)            = delete;
+  node_topology &operator=(const node_topology &) = delete;
+
+  ~node_topology() {
+    if (leaders != MPI_COMM_NULL)
+      MPI_Comm_free(&leaders);
+    if (node != MPI_COMM_NULL)
+      MPI_Comm_free(&node);
+  }
+
+  // Same result as a flat MPI_Scatterv from island rank 0 with `counts` per island rank.
+  template <typename VT>
+  std::vector<VT> scatterv(const std::vector<VT> &send, const std::vector<int> &counts) const {
+    auto type = mpicpp::predefined_datatype<VT>().get();
+    std::vector<VT> node_buf(leaders != MPI_COMM_NULL ? member_total(counts) : 0);
+    scatter_to_leaders(send.data(), counts, node_buf.data(), true);
+    std::vector<int> member_counts, member_displs;
+    member_layout(counts, member_counts, member_displs);
+    std::vector<VT> local(counts[island_rank()]);
+    MPI_Scatterv(node_buf.data(), member_counts.data(), member_displs.data(), type, local.data(),
+                 static_cast<int>(local.size()), type, 0, node);
+    return local;
+  }
+
+  // First level only: every leader receives the rows of its node's members, in node rank order,
+  // into `node_buf`. With `to_root` false island rank 0 keeps its own node's rows in `send`, which
+  // may then be `node_buf` itself: the root receives MPI_IN_PLACE.
+  template <typename VT>
+  void scatter_to_leaders(const VT *send, const std::vector<int> &counts, VT *node_buf,
+                          bool to_root) const {
+    if (leaders == MPI_COMM_NULL)
+      return;
+    auto type = mpicpp::predefined_datatype<VT>().get();
+    std::vector<VT> packed;
+    std::vector<int> node_counts, node_displs;
+    const VT *src   = pack_node_major(send, counts, packed, node_counts, node_displs);
+    const bool in_place = !to_root && island_rank() == 0;
+    MPI_Scatterv(src, node_counts.data(), node_displs.data(), type,
+                 in_place ? MPI_IN_PLACE : static_cast<void *>(node_buf),
+                 static_cast<int>(member_total(counts)), type, 0, leaders);
+  }
+
+  // Same result as a flat MPI_Gatherv to island rank 0, empty on every other rank.
+  template <typename VT>
+  std::vector<VT> gatherv(const std::vector<VT> &local, const std::vector<int> &counts) const {
+    return gatherv(local.data(), counts);
+  }
+
+  // `local` holds counts[island rank] elements, e.g. a view into a shared_window
+  template <typename VT>
+  std::vector<VT> gatherv(const VT *local, const std::vector<int> &counts) const {
+    auto type = mpicpp::predefined_datatype<VT>().get();
+    std::vector<int> member_counts, member_displs;
+    member_layout(counts, member_counts, member_displs);
+    std::vector<VT> node_buf(node_rank == 0 ? member_total(counts) : 0);
+    MPI_Gatherv(local, counts[island_rank()], type, node_buf.data(),
+                member_counts.data(), member_displs.data(), type, 0, node);
+
+    std::vector<VT> out;
+    if (leaders != MPI_COMM_NULL) {
+      std::vector<int> node_counts, node_displs;
+      std::vector<VT> packed;
+      if (island_rank() == 0) {
+        node_layout(counts, node_counts, node_displs);
+        packed.resize(std::accumulate(counts.begin(), counts.end(), std::size_t{0}));
+      }
+      MPI_Gatherv(node_buf.data(), static_cast<int>(node_buf.size()), type, packed.data(),
+                  node_counts.data(), node_displs.data(), type, 0, leaders);
+      if (island_rank() == 0)
+        out = unpack_node_major(packed, counts);
+    }
+    return out;
+  }
+
+  int island_rank() const {
+    int r;
+    MPI_Comm_rank(island, &r);
+    return r;
+  }
+
+  // element offset of every island rank's rows in island rank order
+  static std::vector<std::size_t> island_displs(const std::vector<int> &counts) {
+    std::vector<std::size_t> d(counts.size(), 0);
+    for (std::size_t r = 1; r < counts.size(); ++r) {
+      d[r] = d[r - 1] + counts[r - 1];
+    }
+    return d;
+  }
+
+private:
+  static MPI_Comm split_shared(const mpicpp::comm &island_comm) {
+    MPI_Comm shared;
+    MPI_Comm_split_type(island_comm.get(), MPI_COMM_TYPE_SHARED, island_comm.rank(), MPI_INFO_NULL,
+                        &shared);
+    return shared;
+  }
+
+  std::size_t member_total(const std::vector<int> &counts) const {
+    std::size_t total = 0;
+    for (int m : members) {
+      total += counts[m];
+    }
+    return total;
+  }
+
+  void member_layout(const std::vector<int> &counts, std::vector<int> &c,
+                     std::vector<int> &d) const {
+    c.clear();
+    d.assign(members.size(), 0);
+    for (int m : members) {
+      c.push_back(counts[m]);
+    }
+    if (!c.empty())
+      std::partial_sum(c.begin(), c.end() - 1, d.begin() + 1);
+  }
+
+  void node_layout(const std::vector<int> &counts, std::vector<int> &c,
+                   std::vector<int> &d) const {
+    c.assign(nodes.size(), 0);
+    d.assign(nodes.size(), 0);
+    for (std::size_t n = 0; n < nodes.size(); ++n) {
+      for (int m : nodes[n]) {
+        c[n] += counts[m];
+      }
+    }
+    if (!c.empty())
+      std::partial_sum(c.begin(), c.end() - 1, d.begin() + 1);
+  }
+
+  // island rank order is node-major whenever ranks are placed in blocks per node
+  bool node_major_is_identity() const {
+    int expect = 0;
+    for (auto const &n : nodes) {
+      for (int m : n) {
+        if (m != expect++)
+          return false;
+      }
+    }
+    return true;
+  }
+
+  template <typename VT>
+  const VT *pack_node_major(const VT *send, const std::vector<int> &counts,
+                            std::vector<VT> &packed, std::vector<int> &c,
+                            std::vector<int> &d) const {
+    if (island_rank() != 0)
+      return nullptr;
+    node_layout(counts, c, d);
+    if (node_major_is_identity())
+      return send;
+    auto src = island_displs(counts);
+    packed.reserve(src.back() + counts.back());
+    for (auto const &n : nodes) {
+      for (int m : n) {
+        packed.insert(packed.end(), send + src[m], send + src[m] + counts[m]);
+      }
+    }
+    return packed.data();
+  }
+
+  template <typename VT>
+  std::vector<VT> unpack_node_major(std::vector<VT> &packed, const std::vector<int> &counts) const {
+    if (node_major_is_identity())
+      return std::move(packed);
+    auto dst = island_displs(counts);
+    std::vector<VT> out(packed.size());
+    std::size_t pos = 0;
+    for (auto const &n : nodes) {
+      for (int m : n) {
+        std::copy(packed.begin() + pos, packed.begin() + pos + counts[m], out.begin() + dst[m]);
+        pos += counts[m];
+      }
+    }
+    return out;
+  }
+};
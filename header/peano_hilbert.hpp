@@ -0,0 +1,217 @@
+#pragma once
+
+#include "attribute_helper.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <numeric>
+#include <string>
+#include <vector>
+
+// bits per dimension of a Peano-Hilbert key, 3 * 21 = 63 bits fit in a uint64
+constexpr int ph_key_bits = 21;
+
+// Skilling's transpose form of the 3D Hilbert curve, interleaved into one key
+inline std::uint64_t peano_hilbert_key(std::uint32_t x, std::uint32_t y, std::uint32_t z,
+                                       int bits = ph_key_bits) {
+  std::uint32_t X[3] = {x, y, z};
+  const std::uint32_t M = 1u << (bits - 1);
+
+  // inverse undo excess work
+  for (std::uint32_t Q = M; Q > 1; Q >>= 1) {
+    const std::uint32_t P = Q - 1;
+    for (int i = 0; i < 3; ++i) {
+      if (X[i] & Q) {
+        X[0] ^= P;
+      } else {
+        const std::uint32_t t = (X[0] ^ X[i]) & P;
+        X[0] ^= t;
+        X[i] ^= t;
+      }
+    }
+  }
+
+  // gray encode
+  X[1] ^= X[0];
+  X[2] ^= X[1];
+  std::uint32_t t = 0;
+  for (std::uint32_t Q = M; Q > 1; Q >>= 1) {
+    if (X[2] & Q)
+      t ^= Q - 1;
+  }
+  for (auto &xi : X) {
+    xi ^= t;
+  }
+
+  std::uint64_t key = 0;
+  for (int b = bits - 1; b >= 0; --b) {
+    for (int i = 0; i < 3; ++i) {
+      key = (key << 1) | ((X[i] >> b) & 1u);
+    }
+  }
+  return key;
+}
+
+// keys of (N,3) positions inside the periodic box [0, box_size)
+inline std::vector<std::uint64_t> peano_hilbert_keys(const std::vector<double> &coords,
+                                                     double box_size) {
+  const double cells = static_cast<double>(1u << ph_key_bits);
+  const double scale = cells / box_size;
+  const std::uint32_t max_cell = (1u << ph_key_bits) - 1;
+
+  auto to_cell = [&](double x) {
+    x = std::fmod(x, box_size);
+    if (x < 0.0)
+      x += box_size;
+    return std::min(static_cast<std::uint32_t>(x * scale), max_cell);
+  };
+
+  std::vector<std::uint64_t> keys(coords.size() / 3);
+  for (std::size_t i = 0; i < keys.size(); ++i) {
+    keys[i] = peano_hilbert_key(to_cell(coords[3 * i]), to_cell(coords[3 * i + 1]),
+                                to_cell(coords[3 * i + 2]));
+  }
+  return keys;
+}
+
+// reorder rows of width `width` so that new row i is old row order[i]
+template <typename VT>
+void reorder_rows(std::vector<VT> &data, std::size_t width, const std::vector<std::size_t> &order) {
+  std::vector<VT> out(order.size() * width);
+  for (std::size_t i = 0; i < order.size(); ++i) {
+    std::copy_n(data.begin() + order[i] * width, width, out.begin() + i * width);
+  }
+  data = std::move(out);
+}
+
+// send send_rows[r] consecutive rows to rank r, returns the number of rows received
+template <typename VT>
+std::size_t alltoall_rows(std::vector<VT> &data, std::size_t width,
+                          const std::vector<int> &send_rows, const mpicpp::comm &comm) {
+  const int size = comm.size();
+  std::vector<int> recv_rows(size);
+  MPI_Alltoall(send_rows.data(), 1, MPI_INT, recv_rows.data(), 1, MPI_INT, comm.get());
+
+  std::vector<int> send_disps(size, 0), recv_disps(size, 0);
+  for (int i = 1; i < size; ++i) {
+    send_disps[i] = send_disps[i - 1] + send_rows[i - 1];
+    recv_disps[i] = recv_disps[i - 1] + recv_rows[i - 1];
+  }
+  const std::size_t nrecv = recv_disps[size - 1] + recv_rows[size - 1];
+
+  // one row is one MPI element so the counts stay in rows
+  MPI_Datatype row_type;
+  MPI_Type_contiguous(static_cast<int>(std::max<std::size_t>(width, 1) * sizeof(VT)), MPI_BYTE,
+                      &row_type);
+  MPI_Type_commit(&row_type);
+  std::vector<VT> out(nrecv * width);
+  MPI_Alltoallv(data.data(), send_rows.data(), send_disps.data(), row_type, out.data(),
+                recv_rows.data(), recv_disps.data(), row_type, comm.get());
+  MPI_Type_free(&row_type);
+
+  data = std::move(out);
+  return nrecv;
+}
+
+inline std::vector<std::size_t> key_sort_order(const std::vector<std::uint64_t> &keys) {
+  std::vector<std::size_t> order(keys.size());
+  std::iota(order.begin(), order.end(), 0);
+  std::stable_sort(order.begin(), order.end(),
+                   [&](std::size_t a, std::size_t b) { return keys[a] < keys[b]; });
+  return order;
+}
+
+// sample sort splitters: rows per destination rank for locally sorted keys
+inline std::vector<int> ph_partition(const std::vector<std::uint64_t> &sorted_keys,
+                                     const mpicpp::comm &comm) {
+  const int size = comm.size();
+  constexpr std::uint64_t no_sample = ~std::uint64_t{0};
+
+  std::vector<std::uint64_t> samples(size - 1, no_sample);
+  if (!sorted_keys.empty()) {
+    for (int i = 1; i < size; ++i) {
+      samples[i - 1] = sorted_keys[(sorted_keys.size() * i) / size];
+    }
+  }
+  std::vector<std::uint64_t> all_samples(static_cast<std::size_t>(size) * (size - 1));
+  MPI_Allgather(samples.data(), size - 1, MPI_UINT64_T, all_samples.data(), size - 1,
+                MPI_UINT64_T, comm.get());
+  all_samples.erase(std::remove(all_samples.begin(), all_samples.end(), no_sample),
+                    all_samples.end());
+  std::sort(all_samples.begin(), all_samples.end());
+
+  std::vector<std::uint64_t> splitters;
+  for (int i = 1; i < size && !all_samples.empty(); ++i) {
+    splitters.push_back(all_samples[(all_samples.size() * i) / size]);
+  }
+
+  std::vector<int> send_rows(size, 0);
+  for (auto key : sorted_keys) {
+    auto dest = std::upper_bound(splitters.begin(), splitters.end(), key) - splitters.begin();
+    ++send_rows[dest];
+  }
+  return send_rows;
+}
+
+// first row and row count of every top-level key cell of one PartType
+struct ph_cell_offsets {
+  std::string group{};
+  int level{0};
+  std::vector<std::uint64_t> first_row{};
+  std::vector<std::uint64_t> count{};
+
+  // keys must be globally sorted over the ranks of comm
+  void compute(const std::vector<std::uint64_t> &keys, const mpicpp::comm &comm) {
+    const std::size_t ncells = std::size_t{1} << (3 * level);
+    const int shift = 3 * (ph_key_bits - level);
+    count.assign(ncells, 0);
+    for (auto key : keys) {
+      ++count[key >> shift];
+    }
+    MPI_Allreduce(MPI_IN_PLACE, count.data(), static_cast<int>(ncells), MPI_UINT64_T, MPI_SUM,
+                  comm.get());
+    first_row.assign(ncells, 0);
+    std::partial_sum(count.begin(), count.end() - 1, first_row.begin() + 1);
+  }
+
+  // every rank of the file communicator calls this, only `writer` puts data
+  void write_to_group(const H5::Group &offsets_grp, bool writer,
+                      const H5::DSetMemXferPropList &xfer = H5::DSetMemXferPropList::DEFAULT) const {
+    auto grp = offsets_grp.createGroup(group);
+    write_attribute(grp, "Level", static_cast<std::int32_t>(level));
+    write_attribute(grp, "KeyBits", static_cast<std::int32_t>(ph_key_bits));
+
+    hsize_t dims[1] = {count.size()};
+    auto h5dt = get_pred_type<std::uint64_t>();
+    for (auto [name, values] : {std::pair{"FirstRow", &first_row}, std::pair{"Count", &count}}) {
+      H5::DataSpace file_space(1, dims);
+      H5::DataSpace mem_space(1, dims);
+      auto ds = grp.createDataSet(name, h5dt, file_space);
+      if (!writer) {
+        file_space.selectNone();
+        mem_space.selectNone();
+      }
+      ds.write(values->data(), h5dt, mem_space, file_space, xfer);
+    }
+  }
+};
+
+void write_ph_offsets_parallel(const H5::H5File &file, const std::vector<ph_cell_offsets> &offsets,
+                               const mpicpp::comm &comm) {
+  auto grp  = file.createGroup("/Offsets");
+  auto xfer = create_mpi_xfer();
+  for (auto const &off : offsets) {
+    off.write_to_group(grp, comm.rank() == 0, xfer);
+  }
+}
+
+void write_ph_offsets_1proc(const H5::H5File &file, const std::vector<ph_cell_offsets> &offsets,
+                            const mpi_state &state) {
+  if (state.i_rank != 0)
+    return;
+  auto grp = file.createGroup("/Offsets");
+  for (auto const &off : offsets) {
+    off.write_to_group(grp, true);
+  }
+}
@@ -0,0 +1,99 @@
+#pragma once
+
+#include "io_stats.hpp"
+
+#include <mpi.h>
+
+#include <deque>
+#include <functional>
+
+// Per-rank times of the pipelined serial read, only island rank 0 reads.
+struct pipeline_stats {
+  double read_s{0.0};
+  // reads that started while a scatter was still in flight, an upper bound of the overlap
+  double overlap_s{0.0};
+  // blocked in MPI_Wait for a scatter
+  double wait_s{0.0};
+
+  void clear() { *this = pipeline_stats{}; }
+};
+
+inline pipeline_stats &global_pipeline_stats() {
+  static pipeline_stats stats;
+  return stats;
+}
+
+// Non-blocking scatters that stay in flight across datasets and PartTypes, so island rank 0
+// reads the next dataset from disk while the previous ones are still being sent.
+// Stages complete in the order they were posted.
+struct scatter_pipeline {
+  struct stage {
+    MPI_Request request{MPI_REQUEST_NULL};
+    double posted{0.0};
+    // gets the seconds from posting to completion, moves the rows into the dataset
+    std::function<void(double)> finish;
+  };
+
+  // scatters in flight before the oldest one is waited for
+  std::size_t depth{2};
+  std::deque<stage> inflight{};
+
+  explicit scatter_pipeline(std::size_t depth_) : depth(depth_) {}
+
+  scatter_pipeline(const scatter_pipeline &)            = delete;
+  scatter_pipeline &operator=(const scatter_pipeline &) = delete;
+
+  // completes the finished stages at the front without blocking
+  void progress() {
+    while (!inflight.empty()) {
+      int done = 0;
+      MPI_Test(&inflight.front().request, &done, MPI_STATUS_IGNORE);
+      if (!done)
+        return;
+      complete_front(MPI_Wtime());
+    }
+  }
+
+  // runs a disk read, accounted as overlapped when a scatter is still in flight
+  template <typename F>
+  void read(F &&f) {
+    progress();
+    const bool overlapped = !inflight.empty();
+    const double t0       = MPI_Wtime();
+    f();
+    const double dt = MPI_Wtime() - t0;
+    auto &stats     = global_pipeline_stats();
+    stats.read_s += dt;
+    if (overlapped)
+      stats.overlap_s += dt;
+  }
+
+  void post(MPI_Request request, std::function<void(double)> finish) {
+    inflight.push_back({request, MPI_Wtime(), std::move(finish)});
+    while (inflight.size() > depth) {
+      wait_front();
+    }
+  }
+
+  // must be called on every rank before the scattered rows are used
+  void drain() {
+    while (!inflight.empty()) {
+      wait_front();
+    }
+  }
+
+private:
+  void wait_front() {
+    const double t0 = MPI_Wtime();
+    MPI_Wait(&inflight.front().request, MPI_STATUS_IGNORE);
+    const double t1 = MPI_Wtime();
+    global_pipeline_stats().wait_s += t1 - t0;
+    complete_front(t1);
+  }
+
+  void complete_front(double now) {
+    auto s = std::move(inflight.front());
+    inflight.pop_front();
+    s.finish(now - s.posted);
+  }
+};
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <mpi.h>
+
+#include <cstddef>
+
+// MPI-3 shared-memory segment of one node: node rank 0 allocates `count` elements, every rank
+// of the node maps the same memory at `base`. Freeing is collective over the node communicator.
+template <typename VT>
+struct shared_window {
+  MPI_Win win{MPI_WIN_NULL};
+  VT *base{nullptr};
+  std::size_t count{0};
+
+  shared_window(std::size_t count_, MPI_Comm node) {
+    int node_rank;
+    MPI_Comm_rank(node, &node_rank);
+    const MPI_Aint bytes = node_rank == 0 ? static_cast<MPI_Aint>(count_ * sizeof(VT)) : 0;
+    VT *mine             = nullptr;
+    MPI_Win_allocate_shared(bytes, sizeof(VT), MPI_INFO_NULL, node, &mine, &win);
+    MPI_Aint size;
+    int disp_unit;
+    MPI_Win_shared_query(win, 0, &size, &disp_unit, &base);
+    count = static_cast<std::size_t>(size) / sizeof(VT);
+    // passive epoch for the lifetime of the window, publish() orders the stores
+    MPI_Win_lock_all(MPI_MODE_NOCHECK, win);
+  }
+
+  shared_window(const shared_window &)            = delete;
+  shared_window &operator=(const shared_window &) = delete;
+
+  ~shared_window() {
+    MPI_Win_unlock_all(win);
+    MPI_Win_free(&win);
+  }
+
+  // collective over the node: stores of the writers are visible to every rank afterwards
+  void publish(MPI_Comm node) {
+    MPI_Win_sync(win);
+    MPI_Barrier(node);
+    MPI_Win_sync(win);
+  }
+};
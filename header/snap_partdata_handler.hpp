@@ -1,10 +1,35 @@
 #pragma once
 
 #include "attribute_helper.hpp"
+#include "columnar_snapshot.hpp"
+#include "content_hash.hpp"
+#include "derived_fields.hpp"
+#include "fixed_point.hpp"
 #include "general_utils.hpp"
-
+#include "id_codec.hpp"
+#include "io_planner.hpp"
+#include "io_stats.hpp"
+#include "lazy_cache.hpp"
+#include "mapped_range.hpp"
+#include "mem_stats.hpp"
+#include "mpio_report.hpp"
+#include "node_topology.hpp"
+#include "peano_hilbert.hpp"
+#include "scatter_pipeline.hpp"
+#include "shared_window.hpp"
+#include "timer_registry.hpp"
+#include "unit_conversion.hpp"
+#include "write_behind.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <limits>
+#include <memory>
 #include <numeric>
+#include <optional>
 #include <tuple>
+#include <type_traits>
 
 struct dataset_base {
   virtual void read_dataset_1proc(const H5::Group &, const std::string &, const int) = 0;
@@ -23,6 +48,8 @@ struct dataset_attributes : virtual dataset_base {
   double mass_scaling{0.0};
   double to_cgs{0.0};
   double velocity_scaling{0.0};
+  // what the rows are in: code units as stored by the simulation, or converted by --physical-cgs
+  unit_system units{unit_system::code};
 
   virtual void print() const override {
     PRINT_VAR(a_scaling);
@@ -45,6 +72,7 @@ struct dataset_attributes : virtual dataset_base {
     read_attribute(dataset, "mass_scaling", mass_scaling);
     read_attribute(dataset, "to_cgs", to_cgs);
     read_attribute(dataset, "velocity_scaling", velocity_scaling);
+    read_units(dataset);
   }
 
   virtual void read_dataset_parallel(const H5::Group &grp, const std::string &dataset_name,
@@ -56,6 +84,7 @@ struct dataset_attributes : virtual dataset_base {
     read_attribute(dataset, "mass_scaling", mass_scaling);
     read_attribute(dataset, "to_cgs", to_cgs);
     read_attribute(dataset, "velocity_scaling", velocity_scaling);
+    read_units(dataset);
   }
 
   virtual void distribute_data(const mpicpp::comm &comm) override {
@@ -65,30 +94,74 @@ struct dataset_attributes : virtual dataset_base {
     comm.ibcast(mass_scaling, 0);
     comm.ibcast(to_cgs, 0);
     comm.ibcast(velocity_scaling, 0);
+    int physical = units == unit_system::physical_cgs;
+    comm.ibcast(physical, 0);
+    units = physical ? unit_system::physical_cgs : unit_system::code;
+  }
+
+  void read_units(const H5::DataSet &dataset) {
+    units = unit_system::code;
+    if (dataset.attrExists(unit_system_attribute)) {
+      std::string name;
+      read_attribute(dataset, unit_system_attribute, name);
+      units = parse_unit_system(name);
+    }
   }
 
   void write_to_file_parallel(const H5::Group &grp, const std::string &dataset_name,
                               const mpicpp::comm &comm) const override {
-    auto dataset = grp.openDataSet(dataset_name);
-    write_attribute(dataset, "a_scaling", a_scaling);
-    write_attribute(dataset, "h_scaling", h_scaling);
-    write_attribute(dataset, "length_scaling", length_scaling);
-    write_attribute(dataset, "mass_scaling", mass_scaling);
-    write_attribute(dataset, "to_cgs", to_cgs);
-    write_attribute(dataset, "velocity_scaling", velocity_scaling);
+    write_attributes(grp.openDataSet(dataset_name));
   }
 
   void write_to_file_1proc(const H5::Group &grp, const std::string &dataset_name,
                            const mpicpp::comm &comm) const {
     if (comm.rank() != 0)
       return;
-    auto dataset = grp.openDataSet(dataset_name);
+    write_attributes(grp.openDataSet(dataset_name));
+  }
+
+  void write_attributes(const H5::DataSet &dataset) const {
     write_attribute(dataset, "a_scaling", a_scaling);
     write_attribute(dataset, "h_scaling", h_scaling);
     write_attribute(dataset, "length_scaling", length_scaling);
     write_attribute(dataset, "mass_scaling", mass_scaling);
     write_attribute(dataset, "to_cgs", to_cgs);
     write_attribute(dataset, "velocity_scaling", velocity_scaling);
+    if (units != unit_system::code)
+      write_attribute(dataset, unit_system_attribute, std::string(unit_system_name(units)));
+  }
+
+  // --columnar-out: the same six attributes as manifest entries, converted rows add
+  // "physical_cgs" = 1
+  std::vector<std::pair<std::string, double>> column_attributes() const {
+    std::vector<std::pair<std::string, double>> attrs{
+      {"a_scaling", a_scaling},       {"h_scaling", h_scaling},
+      {"length_scaling", length_scaling}, {"mass_scaling", mass_scaling},
+      {"to_cgs", to_cgs},             {"velocity_scaling", velocity_scaling}};
+    if (units == unit_system::physical_cgs)
+      attrs.emplace_back("physical_cgs", 1.0);
+    return attrs;
+  }
+
+  // --columnar-in, on every rank: names missing from the manifest keep their value
+  void read_column_attributes(const column_entry &col) {
+    units = unit_system::code;
+    for (auto const &[attr, value] : col.attributes) {
+      if (attr == "a_scaling")
+        a_scaling = value;
+      else if (attr == "h_scaling")
+        h_scaling = value;
+      else if (attr == "length_scaling")
+        length_scaling = value;
+      else if (attr == "mass_scaling")
+        mass_scaling = value;
+      else if (attr == "to_cgs")
+        to_cgs = value;
+      else if (attr == "velocity_scaling")
+        velocity_scaling = value;
+      else if (attr == "physical_cgs" && value != 0.0)
+        units = unit_system::physical_cgs;
+    }
   }
 };
 
@@ -99,8 +172,123 @@ struct dataset_data : virtual dataset_base {
   std::vector<hsize_t> local_dataspace_max_dims{};
   std::vector<hsize_t> total_dataspace_dims{};
   std::string name{};
+  // set while this rank's rows are a read-only view instead of data_chunk: into a node-shared
+  // segment (read_dataset_shared) or into the input file itself (read_dataset_mapped)
+  std::shared_ptr<shared_window<VT>> window{};
+  std::shared_ptr<mapped_range> mapping{};
+  std::size_t view_offset{0};
+  std::size_t view_count{0};
+  // --resume: the output already holds a completed copy of the same source, skip the dataset
+  bool reuse{false};
+  // --derived-only: not an input of a requested derived field, never read nor written
+  bool unused{false};
+  std::uint64_t fingerprint{0};
+  std::uint64_t hash{0};
+  // --lazy: set by open_lazy, reads the rows on the first require(). Until they are modified
+  // they can be evicted through global_lazy_cache() and are read again on the next require().
+  std::function<void()> loader{};
+  bool loaded{false};
+  std::size_t lazy_bytes{0};
+  // --fixed-point-coords: side of the periodic box the rows are written relative to, 0 writes
+  // them as they are. Reads decode any dataset carrying fixed_point_attribute.
+  double fixed_point_box{0.0};
+  // --id-codec: the dataset is created chunked, through the ID filter
+  bool id_codec{false};
+
+  // the rows as they go to disk: unchanged, or as 32-bit fractions of the box
+  struct file_rows {
+    const VT *rows;
+    std::vector<std::uint32_t> fixed{};
+    double scale{0.0};
+
+    const void *data() const {
+      return scale > 0 ? static_cast<const void *>(fixed.data()) : static_cast<const void *>(rows);
+    }
+    H5::PredType type() const { return scale > 0 ? H5::PredType::STD_U32LE : get_pred_type<VT>(); }
+    std::size_t elem_size() const { return scale > 0 ? sizeof(std::uint32_t) : sizeof(VT); }
+    // on every rank that took part in creating `ds`
+    void mark(const H5::DataSet &ds) const {
+      if (scale > 0)
+        write_attribute(ds, fixed_point_attribute, scale);
+    }
+  };
+
+  static file_rows encode_rows(const VT *rows, std::size_t n, double box) {
+    file_rows out{rows};
+    if constexpr (std::is_floating_point_v<VT>) {
+      if (box > 0) {
+        out.fixed = encode_fixed_point(rows, n, box);
+        out.scale = box / fixed_point_steps;
+      }
+    }
+    return out;
+  }
 
-  dataset_data(const std::string &name_) : name(name_) {}
+  // after `n` rows of `ds` were read into `rows`: HDF5 converted the integers, scale them back
+  static void decode_rows(const H5::DataSet &ds, VT *rows, std::size_t n) {
+    if constexpr (std::is_floating_point_v<VT>) {
+      if (ds.attrExists(fixed_point_attribute)) {
+        double scale = 0.0;
+        read_attribute(ds, fixed_point_attribute, scale);
+        decode_fixed_point(rows, n, scale);
+      }
+    }
+  }
+
+  dataset_data(const std::string &name_) : name(name_) {
+    // reading a dataset written with --id-codec needs the filter too
+    register_id_codec();
+    global_buffers().add(this, [](const void *self) {
+      return static_cast<const dataset_data *>(self)->data_chunk.capacity() * sizeof(VT);
+    });
+  }
+
+  dataset_data(const dataset_data &)            = delete;
+  dataset_data &operator=(const dataset_data &) = delete;
+
+  ~dataset_data() {
+    global_buffers().remove(this);
+    if (loader)
+      global_lazy_cache().forget(this);
+  }
+
+  bool is_view() const { return window || mapping; }
+
+  // this rank's elements, wherever they live
+  const VT *rows_data() const {
+    if (!is_view())
+      return data_chunk.data();
+    const VT *base = window ? window->base : static_cast<const VT *>(mapping->data());
+    return base + view_offset;
+  }
+
+  std::size_t rows_size() const { return is_view() ? view_count : data_chunk.size(); }
+
+  // copy a view into data_chunk before the rows are modified, collective over the node for
+  // shared views and over the island for lazy datasets that are not resident
+  void materialize() {
+    pin();
+    if (!is_view())
+      return;
+    data_chunk.assign(rows_data(), rows_data() + rows_size());
+    window.reset();
+    mapping.reset();
+  }
+
+  // --physical-cgs: multiplies this rank's rows by `factor`, a view is copied into data_chunk
+  // in the same pass. Collective like materialize().
+  void scale_rows(double factor) {
+    pin();
+    if (!is_view()) {
+      scale_values(data_chunk.data(), data_chunk.data(), data_chunk.size(), factor);
+      return;
+    }
+    std::vector<VT> scaled(rows_size());
+    scale_values(rows_data(), scaled.data(), scaled.size(), factor);
+    data_chunk.swap(scaled);
+    window.reset();
+    mapping.reset();
+  }
 
   void print() const {
     fmt::print("Dataset info: {}\n", name);
@@ -115,7 +303,85 @@ struct dataset_data : virtual dataset_base {
     if (rank != 0) {
       return;
     }
-    auto ds             = grp.openDataSet(dataset_name);
+    io_timer timer(io_op::read, name);
+    auto ds = grp.openDataSet(dataset_name);
+    data_chunk.resize(read_shape(ds));
+    timer.bytes = data_chunk.size() * sizeof(VT);
+    hdf5_trace_scope trace(trace_op::read, trace_mode::serial, ds.getId(), 0, timer.bytes);
+    ds.read(data_chunk.data(), get_pred_type<VT>());
+    decode_rows(ds, data_chunk.data(), data_chunk.size());
+  }
+
+  // Island rank 0: maps the raw bytes of an uncompressed contiguous dataset instead of reading
+  // them, anything else goes through read_dataset_1proc. The rows stay a read-only view of the
+  // file until materialize(), so only datasets that are modified are ever copied.
+  void read_dataset_mapped(const H5::Group &grp, const std::string &dataset_name, const int rank) {
+    if (rank != 0) {
+      return;
+    }
+    auto ds            = grp.openDataSet(dataset_name);
+    const auto offset  = raw_file_offset(ds, get_pred_type<VT>());
+    if (offset == HADDR_UNDEF) {
+      dataset_data::read_dataset_1proc(grp, dataset_name, rank);
+      return;
+    }
+    io_timer timer(io_op::read, name);
+    view_offset = 0;
+    view_count  = read_shape(ds);
+    timer.bytes = view_count * sizeof(VT);
+    data_chunk.clear();
+    data_chunk.shrink_to_fit();
+    mapping = std::make_shared<mapped_range>(ds.getFileName(), offset, timer.bytes);
+  }
+
+  // Collective over the island: reads the shape only, the rows are read by the first require().
+  // With `parallel` they are read with read_dataset_parallel, otherwise island rank 0 reads and
+  // scatters them and only it needs a valid `grp`.
+  void open_lazy(const H5::Group &grp, const std::string &dataset_name, const mpicpp::comm &comm,
+                 bool parallel) {
+    unsigned long long elems = 0;
+    if (parallel || comm.rank() == 0)
+      elems = read_shape(grp.openDataSet(dataset_name));
+    MPI_Bcast(&elems, 1, MPI_UNSIGNED_LONG_LONG, 0, comm.get());
+    lazy_bytes = elems * sizeof(VT);
+    loaded     = false;
+    loader     = [this, grp, dataset_name, &comm, parallel] {
+      if (parallel) {
+        dataset_data::read_dataset_parallel(grp, dataset_name, comm);
+      } else {
+        dataset_data::read_dataset_1proc(grp, dataset_name, comm.rank());
+        dataset_data::distribute_data(comm);
+      }
+    };
+  }
+
+  // the rows are about to be used, collective over the island when they are not resident
+  void require() {
+    if (!loader)
+      return;
+    if (!loaded) {
+      loader();
+      loaded = true;
+    }
+    global_lazy_cache().touch(this, lazy_bytes, [this] { evict(); });
+  }
+
+  // the rows are about to be modified, from now on this is an ordinary dataset
+  void pin() {
+    if (!loader)
+      return;
+    require();
+    global_lazy_cache().forget(this);
+    loader = nullptr;
+  }
+
+  void evict() {
+    std::vector<VT>().swap(data_chunk);
+    loaded = false;
+  }
+
+  // dims of the whole dataset as this rank's share, returns the element count
+  hsize_t read_shape(const H5::DataSet &ds) {
     auto space          = ds.getSpace();
     auto dataspace_rank = space.getSimpleExtentNdims();
     local_dataspace_dims.resize(dataspace_rank);
@@ -123,14 +389,14 @@ struct dataset_data : virtual dataset_base {
     local_dataspace_max_dims.resize(dataspace_rank);
     space.getSimpleExtentDims(local_dataspace_dims.data(), local_dataspace_max_dims.data());
     total_dataspace_dims = local_dataspace_dims;
-    int total_elem       = std::accumulate(local_dataspace_dims.begin(), local_dataspace_dims.end(),
-                                           hsize_t{1}, std::multiplies<hsize_t>());
-    data_chunk.resize(total_elem);
-    ds.read(data_chunk.data(), get_pred_type<VT>());
+    return std::accumulate(local_dataspace_dims.begin(), local_dataspace_dims.end(), hsize_t{1},
+                           std::multiplies<hsize_t>());
   }
 
   void read_dataset_parallel(const H5::Group &grp, const std::string &dataset_name,
-                             const mpicpp::comm &comm) {
+                             const mpicpp::comm &comm,
+                             H5FD_mpio_xfer_t mode = H5FD_MPIO_COLLECTIVE) {
+    io_timer timer(io_op::read, name);
     auto ds         = grp.openDataSet(dataset_name);
     auto file_space = ds.getSpace();
 
@@ -175,16 +441,21 @@ struct dataset_data : virtual dataset_base {
 
     file_space.selectHyperslab(H5S_SELECT_SET, count.data(), start.data());
 
-    // Collective transfer properties
-    auto xfer = create_mpi_xfer();
+    auto xfer = create_mpi_xfer(mode);
 
     // fmt::print("rank_island {}\n start:{}\n count{}\n filespace:{}\n memspace:{}\n", comm.rank(), start, count, total_dataspace_dims, local_dataspace_dims);
 
     // Read
+    timer.bytes = data_chunk.size() * sizeof(VT);
+    hdf5_trace_scope trace(trace_op::read, trace_mode_of(mode), ds.getId(),
+                           offset0 * row_width() * sizeof(VT), timer.bytes);
     ds.read(data_chunk.data(), get_pred_type<VT>(), mem_space, file_space, xfer);
+    decode_rows(ds, data_chunk.data(), data_chunk.size());
+    global_mpio_report().add(io_op::read, name, mode, xfer);
   }
 
   void distribute_data(const mpicpp::comm &comm) override {
+    io_timer timer(io_op::scatter, name);
     // Broadcast dataspace info
     int dataspace_rank = local_dataspace_dims.size();
     comm.ibcast(dataspace_rank, 0);
@@ -214,12 +485,28 @@ struct dataset_data : virtual dataset_base {
     }
     // comm.ibcast(send_counts, 0); //  MAY BE REDUNDANT // commneted since redundent
     // comm.ibcast(send_disps, 0);  //  MAY BE REDUNDANT // commneted since redundent
-    std::vector<VT> local_data(local_entries_count);
-    comm.iscatterv(data_chunk, send_counts, send_disps, local_data, 0);
-    data_chunk = std::move(local_data);
+    // a mapped root keeps its leading rows in place and only sends the rest
+    const bool mapped = mapping != nullptr;
+    std::vector<VT> local_data(mapped ? 0 : local_entries_count);
+    auto dtype = mpicpp::predefined_datatype<VT>().get();
+    MPI_Scatterv(rows_data(), send_counts.data(), send_disps.data(), dtype,
+                 mapped ? MPI_IN_PLACE : local_data.data(), local_entries_count, dtype, 0,
+                 comm.get());
+    if (mapped)
+      view_count = local_entries_count;
+    else
+      data_chunk = std::move(local_data);
+    timer.bytes = rows_size() * sizeof(VT);
   }
 
   void gather_data(const mpicpp::comm &comm) override {
+    pin();
+    // a single rank already holds every row, a mapped view stays unread
+    if (comm.size() == 1)
+      return;
+    materialize();
+    io_timer timer(io_op::gather, name);
+    timer.bytes = data_chunk.size() * sizeof(VT);
     auto total_entries = std::accumulate(total_dataspace_dims.begin(), total_dataspace_dims.end(),
                                          hsize_t{1}, std::multiplies<hsize_t>());
     int local_entries_count =
@@ -249,13 +536,183 @@ struct dataset_data : virtual dataset_base {
     }
   }
 
+  // Broadcasts the shape from island rank 0 and sets this rank's share of the rows.
+  // Returns the element count of every island rank, the same partition as distribute_data.
+  std::vector<int> broadcast_partition(const mpicpp::comm &comm) {
+    int dataspace_rank = local_dataspace_dims.size();
+    comm.ibcast(dataspace_rank, 0);
+    total_dataspace_dims.resize(dataspace_rank);
+    local_dataspace_dims.resize(dataspace_rank);
+    local_dataspace_max_dims.resize(dataspace_rank);
+    comm.ibcast(total_dataspace_dims, 0);
+    comm.ibcast(local_dataspace_dims, 0);
+    comm.ibcast(local_dataspace_max_dims, 0);
+
+    const hsize_t base = local_dataspace_dims[0] / comm.size();
+    const hsize_t rem  = local_dataspace_dims[0] % comm.size();
+    const auto width   = row_width();
+    std::vector<int> counts(comm.size());
+    for (int r = 0; r < comm.size(); ++r) {
+      counts[r] = static_cast<int>((base + (r < static_cast<int>(rem) ? 1 : 0)) * width);
+    }
+    local_dataspace_dims[0] = base + (comm.rank() < static_cast<int>(rem) ? 1 : 0);
+    return counts;
+  }
+
+  // Same partition as distribute_data, but the rows travel root -> node leaders -> node ranks.
+  void distribute_data_hierarchical(const mpicpp::comm &comm, const node_topology &topo) {
+    materialize();
+    io_timer timer(io_op::scatter, name);
+    auto counts = broadcast_partition(comm);
+    data_chunk  = topo.scatterv(data_chunk, counts);
+    timer.bytes = data_chunk.size() * sizeof(VT);
+  }
+
+  // Serial read whose scatter is left in flight on `pipe`, data_chunk holds this rank's rows
+  // once the pipeline completes the stage. Same partition as distribute_data.
+  void read_dataset_pipelined(const H5::Group &grp, const std::string &dataset_name,
+                              const mpicpp::comm &comm, scatter_pipeline &pipe) {
+    if (comm.rank() == 0)
+      pipe.read([&] { dataset_data::read_dataset_1proc(grp, dataset_name, 0); });
+    auto counts = broadcast_partition(comm);
+
+    // everything MPI_Iscatterv points to lives until the stage completes
+    struct buffers {
+      std::vector<VT> send, recv;
+      std::vector<int> counts, displs;
+    };
+    auto buf = std::make_shared<buffers>();
+    buf->send = std::move(data_chunk);
+    buf->recv.resize(counts[comm.rank()]);
+    buf->displs.assign(counts.size(), 0);
+    std::partial_sum(counts.begin(), counts.end() - 1, buf->displs.begin() + 1);
+    buf->counts = std::move(counts);
+    data_chunk.clear();
+
+    auto type = mpicpp::predefined_datatype<VT>().get();
+    MPI_Request request;
+    MPI_Iscatterv(buf->send.data(), buf->counts.data(), buf->displs.data(), type, buf->recv.data(),
+                  static_cast<int>(buf->recv.size()), type, 0, comm.get(), &request);
+    pipe.post(request, [this, buf, group = global_io_stats().group](double seconds) {
+      data_chunk = std::move(buf->recv);
+      buf->send  = std::vector<VT>{};
+      io_group_scope scope(group);
+      global_io_stats().add(io_op::scatter, name, data_chunk.size() * sizeof(VT), seconds);
+    });
+  }
+
+  // Serial read straight into node-shared memory. Island rank 0 reads the whole dataset into a
+  // segment on its node, every other node receives its members' rows once through its leader.
+  // Ranks keep a view of their rows instead of a private copy.
+  void read_dataset_shared(const H5::Group &grp, const std::string &dataset_name,
+                           const mpicpp::comm &comm, const node_topology &topo) {
+    H5::DataSet ds;
+    if (comm.rank() == 0) {
+      ds                  = grp.openDataSet(dataset_name);
+      auto space          = ds.getSpace();
+      auto dataspace_rank = space.getSimpleExtentNdims();
+      local_dataspace_dims.resize(dataspace_rank);
+      local_dataspace_max_dims.resize(dataspace_rank);
+      space.getSimpleExtentDims(local_dataspace_dims.data(), local_dataspace_max_dims.data());
+      total_dataspace_dims = local_dataspace_dims;
+    }
+    auto counts = broadcast_partition(comm);
+    auto displs = node_topology::island_displs(counts);
+    // only read on node rank 0, island rank 0's node holds the whole dataset
+    std::size_t node_total = 0;
+    for (int m : topo.members) {
+      node_total += counts[m];
+    }
+    if (topo.root_node)
+      node_total = displs.back() + counts.back();
+    data_chunk.clear();
+    data_chunk.shrink_to_fit();
+    window = std::make_shared<shared_window<VT>>(node_total, topo.node);
+
+    if (comm.rank() == 0) {
+      io_timer timer(io_op::read, name);
+      timer.bytes = node_total * sizeof(VT);
+      hdf5_trace_scope trace(trace_op::read, trace_mode::serial, ds.getId(), 0, timer.bytes);
+      ds.read(window->base, get_pred_type<VT>());
+      decode_rows(ds, window->base, node_total);
+    }
+    {
+      io_timer timer(io_op::scatter, name);
+      topo.scatter_to_leaders(window->base, counts, window->base, false);
+      window->publish(topo.node);
+      timer.bytes = counts[comm.rank()] * sizeof(VT);
+    }
+
+    view_count = counts[comm.rank()];
+    if (topo.root_node) {
+      view_offset = displs[comm.rank()];
+    } else {
+      unsigned long long mine = view_count, offset = 0;
+      MPI_Exscan(&mine, &offset, 1, MPI_UNSIGNED_LONG_LONG, MPI_SUM, topo.node);
+      view_offset = topo.node_rank == 0 ? 0 : offset;
+    }
+  }
+
+  void gather_data_hierarchical(const mpicpp::comm &comm, const node_topology &topo) {
+    materialize();
+    io_timer timer(io_op::gather, name);
+    timer.bytes = data_chunk.size() * sizeof(VT);
+    // row counts may differ from the scatter partition, e.g. after sort_by_peano_hilbert
+    int mine = static_cast<int>(data_chunk.size());
+    std::vector<int> counts(comm.size());
+    MPI_Allgather(&mine, 1, MPI_INT, counts.data(), 1, MPI_INT, comm.get());
+    data_chunk = topo.gatherv(data_chunk, counts);
+
+    if (comm.rank() == 0) {
+      local_dataspace_dims = total_dataspace_dims;
+    } else {
+      local_dataspace_dims.resize(0);
+      local_dataspace_max_dims.resize(0);
+      total_dataspace_dims.resize(0);
+    }
+  }
+
+  // Views that were never modified are already in place: island rank 0's segment holds the
+  // whole dataset as read, so nothing has to move. Otherwise falls back to the two-level gather.
+  void gather_data_shared(const mpicpp::comm &comm, const node_topology &topo) {
+    int mine = window != nullptr, all = 0;
+    MPI_Allreduce(&mine, &all, 1, MPI_INT, MPI_LAND, comm.get());
+    if (!all) {
+      gather_data_hierarchical(comm, topo);
+      return;
+    }
+    io_timer timer(io_op::gather, name);
+    if (comm.rank() == 0) {
+      view_offset          = 0;
+      view_count           = std::accumulate(total_dataspace_dims.begin(),
+                                             total_dataspace_dims.end(), hsize_t{1},
+                                             std::multiplies<hsize_t>());
+      local_dataspace_dims = total_dataspace_dims;
+    } else {
+      // the segment itself is freed together with the dataset, collectively per node
+      view_count = 0;
+      local_dataspace_dims.resize(0);
+      local_dataspace_max_dims.resize(0);
+      total_dataspace_dims.resize(0);
+    }
+  }
+
   void write_to_file_parallel(const H5::Group &grp, const std::string &dataset_name,
                               const mpicpp::comm &comm) const override {
+    write_to_file_parallel(grp, dataset_name, comm, H5FD_MPIO_COLLECTIVE);
+  }
+
+  void write_to_file_parallel(const H5::Group &grp, const std::string &dataset_name,
+                              const mpicpp::comm &comm, H5FD_mpio_xfer_t mode) const {
+    io_timer timer(io_op::write, name);
+    const auto out = encode_rows(rows_data(), rows_size(), fixed_point_box);
+    timer.bytes    = rows_size() * out.elem_size();
     H5::DataSpace file_space(total_dataspace_dims.size(), total_dataspace_dims.data());
     H5::DataSpace mem_space(local_dataspace_dims.size(), local_dataspace_dims.data());
-    auto h5dt = get_pred_type<VT>();
 
-    auto dataset_handle = grp.createDataSet(dataset_name, h5dt, file_space);
+    auto dataset_handle = grp.createDataSet(dataset_name, out.type(), file_space,
+                                            id_codec_dcpl(id_codec, total_dataspace_dims));
+    out.mark(dataset_handle);
 
     hsize_t start_row = 0;
     MPI_Exscan(&local_dataspace_dims[0], &start_row, 1, MPI_LONG_LONG, MPI_SUM, comm.get());
@@ -267,26 +724,278 @@ struct dataset_data : virtual dataset_base {
     start[0]                   = start_row;
     file_space.selectHyperslab(H5S_SELECT_SET, count.data(), start.data());
 
-    // Collective parallel write
-    auto transfer_prop = create_mpi_xfer();
-    dataset_handle.write(data_chunk.data(), h5dt, mem_space, file_space, transfer_prop);
+    auto transfer_prop = create_mpi_xfer(mode);
+    hdf5_trace_scope trace(trace_op::write, trace_mode_of(mode), dataset_handle.getId(),
+                           start_row * row_width() * out.elem_size(), timer.bytes);
+    dataset_handle.write(out.data(), out.type(), mem_space, file_space, transfer_prop);
+    global_mpio_report().add(io_op::write, name, mode, transfer_prop);
+  }
+
+  std::size_t row_width() const {
+    return std::accumulate(local_dataspace_dims.begin() + 1, local_dataspace_dims.end(),
+                           std::size_t{1}, std::multiplies<std::size_t>());
+  }
+
+  // local permutation of the rows held by this rank
+  void reorder_rows(const std::vector<std::size_t> &order) {
+    materialize();
+    ::reorder_rows(data_chunk, row_width(), order);
+    local_dataspace_dims[0] = order.size();
+  }
+
+  // move consecutive local rows to other ranks, row counts per rank may change
+  void alltoall_rows(const std::vector<int> &send_rows, const mpicpp::comm &comm) {
+    materialize();
+    local_dataspace_dims[0] = ::alltoall_rows(data_chunk, row_width(), send_rows, comm);
   }
 
   void write_to_file_1proc(const H5::Group &grp, const std::string &dataset_name,
                            const mpicpp::comm &comm) const {
     if (comm.rank() == 0) {
-      auto h5dt = get_pred_type<VT>();
+      io_timer timer(io_op::write, name);
+      const auto out = encode_rows(rows_data(), rows_size(), fixed_point_box);
+      timer.bytes    = rows_size() * out.elem_size();
       H5::DataSpace space(local_dataspace_dims.size(), local_dataspace_dims.data());
-      auto dataset = grp.createDataSet(name, h5dt, space);
-      dataset.write(data_chunk.data(), h5dt);
+      auto dataset = grp.createDataSet(name, out.type(), space,
+                                       id_codec_dcpl(id_codec, local_dataspace_dims));
+      out.mark(dataset);
+      hdf5_trace_scope trace(trace_op::write, trace_mode::serial, dataset.getId(), 0, timer.bytes);
+      dataset.write(out.data(), out.type());
+    }
+  }
+
+  // Island rank 0 only, after a gather: moves the rows into a job that creates and writes the
+  // dataset in a group, to run on write_behind's thread. The write is recorded under the
+  // PartType that is current now.
+  std::function<void(const H5::Group &)> release_write_job() {
+    materialize();
+    auto rows = std::make_shared<std::vector<VT>>(std::move(data_chunk));
+    data_chunk.clear();
+    return [rows, dims = local_dataspace_dims, name = name, box = fixed_point_box,
+            codec = id_codec, group = global_io_stats().group](const H5::Group &grp) {
+      const auto t0 = std::chrono::steady_clock::now();
+      // encoded here, off the main thread
+      const auto out            = encode_rows(rows->data(), rows->size(), box);
+      const std::uint64_t bytes = rows->size() * out.elem_size();
+      H5::DataSpace space(dims.size(), dims.data());
+      auto dataset = grp.createDataSet(name, out.type(), space, id_codec_dcpl(codec, dims));
+      out.mark(dataset);
+      {
+        hdf5_trace_scope trace(trace_op::write, trace_mode::serial, dataset.getId(), 0, bytes);
+        dataset.write(out.data(), out.type());
+      }
+      const std::chrono::duration<double> dt = std::chrono::steady_clock::now() - t0;
+      global_io_stats().add(io_op::write, group, name, bytes, dt.count());
+    };
+  }
+
+  // Island rank 0, --resume: fingerprints the source dataset in `in` and reuses the copy in `out`
+  // (null when the output group is missing) if it was written from the same fingerprint and
+  // completed. Returns whether `out` holds a stale copy that has to be unlinked.
+  bool check_resume(const H5::Group &in, const H5::Group *out, const std::filesystem::path &source,
+                    const std::string &group_name) {
+    auto space = in.openDataSet(name).getSpace();
+    std::vector<hsize_t> dims(space.getSimpleExtentNdims());
+    space.getSimpleExtentDims(dims.data());
+    fingerprint = source_fingerprint(source, group_name + "/" + name, dims, sizeof(VT));
+    // a copy encoded against another box, or not at all, is stale, and so is one written with
+    // the other ID layout
+    if (fixed_point_box > 0)
+      fingerprint = fnv1a(&fixed_point_box, sizeof(fixed_point_box), fingerprint);
+    if (id_codec) {
+      const std::uint32_t filter = id_codec_filter;
+      fingerprint                = fnv1a(&filter, sizeof(filter), fingerprint);
+    }
+    reuse       = false;
+    if (!out || !out->nameExists(name))
+      return false;
+    auto ds = out->openDataSet(name);
+    // content_hash is written last, a copy without it was interrupted
+    if (ds.attrExists("source_fingerprint") && ds.attrExists("content_hash")) {
+      std::uint64_t stored = 0;
+      read_attribute(ds, "source_fingerprint", stored);
+      reuse = stored == fingerprint;
+    }
+    return !reuse;
+  }
+
+  // collective over the island, on the distributed rows before they are written
+  void hash_rows(const mpicpp::comm &comm, bool ordered = true) {
+    require();
+    const std::size_t width = local_dataspace_dims.empty() ? 1 : row_width();
+    hash = content_hash(rows_data(), rows_size() / width, width * sizeof(VT), comm.get(), ordered);
+  }
+
+  // after the rows are written, marks the copy as complete for the next --resume
+  void stamp_resume(const H5::Group &grp) const {
+    auto ds = grp.openDataSet(name);
+    write_attribute(ds, "source_fingerprint", fingerprint);
+    write_attribute(ds, "content_hash", hash);
+  }
+
+  // --columnar-out, collective over the island: writes the rows as the column `group`/name of
+  // `out`. With `parallel` every rank writes its rows with MPI-IO at its row offset, otherwise
+  // they are gathered and island rank 0 writes the column with POSIX.
+  void write_column(column_writer &out, const std::string &group, const mpicpp::comm &comm,
+                    bool parallel) {
+    require();
+    if (!parallel)
+      gather_data(comm);
+    io_timer timer(io_op::write, name);
+    column_entry col{group + "/" + name, column_kind<VT>(),
+                     static_cast<std::uint8_t>(sizeof(VT))};
+    col.dims.assign(total_dataspace_dims.begin(), total_dataspace_dims.end());
+    if (parallel) {
+      unsigned long long mine = rows_size(), before = 0, total = 0;
+      MPI_Exscan(&mine, &before, 1, MPI_UNSIGNED_LONG_LONG, MPI_SUM, comm.get());
+      MPI_Allreduce(&mine, &total, 1, MPI_UNSIGNED_LONG_LONG, MPI_SUM, comm.get());
+      if (comm.rank() == 0)
+        before = 0;  // Exscan leaves rank 0 undefined
+      timer.bytes = mine * sizeof(VT);
+      write_column_mpiio(out.column_path(col), rows_data(), before * sizeof(VT), timer.bytes,
+                         total * sizeof(VT), comm);
+    } else if (comm.rank() == 0) {
+      timer.bytes = rows_size() * sizeof(VT);
+      write_column_posix(out.column_path(col), rows_data(), timer.bytes);
+    }
+    if (comm.rank() == 0)
+      out.manifest.columns.push_back(std::move(col));
+  }
+
+  // --columnar-in, on every island rank: maps its share of the column, the same partition as
+  // distribute_data, straight from the file. The rows stay a read-only view until materialize().
+  void map_column(const std::filesystem::path &dir, const column_entry &col,
+                  const mpicpp::comm &comm) {
+    if (col.kind != column_kind<VT>() || col.elem_size != sizeof(VT) || col.dims.empty())
+      throw std::runtime_error(
+        fmt::format("map_column: {} does not hold a column of this type", col.path));
+    io_timer timer(io_op::read, name);
+    total_dataspace_dims.assign(col.dims.begin(), col.dims.end());
+    local_dataspace_dims     = total_dataspace_dims;
+    local_dataspace_max_dims = total_dataspace_dims;
+    const hsize_t base   = total_dataspace_dims[0] / comm.size();
+    const hsize_t rem    = total_dataspace_dims[0] % comm.size();
+    const hsize_t first  = comm.rank() * base + std::min<hsize_t>(comm.rank(), rem);
+    local_dataspace_dims[0] = base + (comm.rank() < static_cast<int>(rem) ? 1 : 0);
+    const std::size_t width = row_width();
+    data_chunk.clear();
+    mapping.reset();
+    view_offset = 0;
+    view_count  = local_dataspace_dims[0] * width;
+    timer.bytes = view_count * sizeof(VT);
+    if (view_count > 0)
+      mapping = std::make_shared<mapped_range>((dir / col.file_name()).string(),
+                                               first * width * sizeof(VT), timer.bytes);
+  }
+
+  // strategy picked by global_io_planner() from the dataset size, file opened with the MPI-IO driver
+  void read_dataset_adaptive(const H5::Group &grp, const std::string &dataset_name,
+                             const mpicpp::comm &comm) {
+    auto space = grp.openDataSet(dataset_name).getSpace();
+    std::vector<hsize_t> dims(space.getSimpleExtentNdims());
+    space.getSimpleExtentDims(dims.data());
+    const std::uint64_t bytes = std::accumulate(dims.begin(), dims.end(), hsize_t{1},
+                                                std::multiplies<hsize_t>()) *
+                                sizeof(VT);
+    switch (global_io_planner().choose(io_op::read, name, bytes, comm.size())) {
+      case io_strategy::serial_scatter:
+        // without a transfer property rank 0 reads independently
+        dataset_data::read_dataset_1proc(grp, dataset_name, comm.rank());
+        dataset_data::distribute_data(comm);
+        break;
+      case io_strategy::collective:
+        dataset_data::read_dataset_parallel(grp, dataset_name, comm, H5FD_MPIO_COLLECTIVE);
+        break;
+      case io_strategy::independent:
+        dataset_data::read_dataset_parallel(grp, dataset_name, comm, H5FD_MPIO_INDEPENDENT);
+        break;
+    }
+  }
+
+  // Not const: serial_scatter gathers the rows to rank 0 first. Dataset creation stays
+  // collective on the parallel file, only the transfer is done by rank 0.
+  void write_to_file_adaptive(const H5::Group &grp, const std::string &dataset_name,
+                              const mpicpp::comm &comm) {
+    require();
+    const std::uint64_t bytes =
+      std::accumulate(total_dataspace_dims.begin(), total_dataspace_dims.end(), hsize_t{1},
+                      std::multiplies<hsize_t>()) *
+      sizeof(VT);
+    // parallel HDF5 writes filtered datasets only collectively
+    const auto strategy = id_codec ? io_strategy::collective
+                                   : global_io_planner().choose(io_op::write, name, bytes,
+                                                                comm.size());
+    switch (strategy) {
+      case io_strategy::serial_scatter: {
+        auto dims = total_dataspace_dims;
+        dataset_data::gather_data(comm);
+        io_timer timer(io_op::write, name);
+        // a 1-rank island skips the gather, its rows may still be a mapped view
+        const auto out = encode_rows(rows_data(), rows_size(), fixed_point_box);
+        timer.bytes    = rows_size() * out.elem_size();
+        H5::DataSpace space(dims.size(), dims.data());
+        auto dataset = grp.createDataSet(dataset_name, out.type(), space,
+                                         id_codec_dcpl(id_codec, dims));
+        out.mark(dataset);
+        if (comm.rank() == 0) {
+          hdf5_trace_scope trace(trace_op::write, trace_mode::independent, dataset.getId(), 0,
+                                 timer.bytes);
+          dataset.write(out.data(), out.type(), space, space,
+                        create_mpi_xfer(H5FD_MPIO_INDEPENDENT));
+        }
+        break;
+      }
+      case io_strategy::collective:
+        dataset_data::write_to_file_parallel(grp, dataset_name, comm, H5FD_MPIO_COLLECTIVE);
+        break;
+      case io_strategy::independent:
+        dataset_data::write_to_file_parallel(grp, dataset_name, comm, H5FD_MPIO_INDEPENDENT);
+        break;
     }
   }
 };
 
 template <typename VT>
 struct dataset_wattr : public dataset_attributes, public dataset_data<VT> {
+  // --physical-cgs: scale factor and Hubble parameter the rows are converted with once they
+  // are on their rank, 0 keeps code units
+  double physical_a{0.0};
+  double physical_h{0.0};
+
   dataset_wattr(const std::string &name_) : dataset_data<VT>(name_) {}
 
+  // Collective over `comm`, after the rows and the attributes arrived. The rows are still in
+  // cache from the read or the scatter. A dataset whose largest value would overflow VT in CGS
+  // on any rank is only made physical and keeps to_cgs, one that overflows even then stays in
+  // code units with a warning from rank 0 of `comm`.
+  void convert_units(const mpicpp::comm &comm) {
+    if constexpr (std::is_floating_point_v<VT>) {
+      if (physical_a <= 0 || units != unit_system::code)
+        return;
+      double peak = max_magnitude(this->rows_data(), this->rows_size());
+      MPI_Allreduce(MPI_IN_PLACE, &peak, 1, MPI_DOUBLE, MPI_MAX, comm.get());
+      const double limit     = static_cast<double>(std::numeric_limits<VT>::max());
+      const double physical  = physical_factor(physical_a, physical_h, a_scaling, h_scaling);
+      const bool to_cgs_fits = peak * physical * cgs_factor(to_cgs) <= limit;
+      if (!to_cgs_fits && !(peak * physical <= limit)) {
+        if (comm.rank() == 0)
+          fmt::print(stderr, "--physical-cgs: {} would overflow in physical units, left in code "
+                             "units\n",
+                     this->name);
+        return;
+      }
+      scoped_timer t("physical_cgs");
+      const double factor = to_cgs_fits ? physical * cgs_factor(to_cgs) : physical;
+      if (factor != 1.0)
+        this->scale_rows(factor);
+      a_scaling = 0.0;
+      h_scaling = 0.0;
+      if (to_cgs != 0.0 && to_cgs_fits)
+        to_cgs = 1.0;
+      units = unit_system::physical_cgs;
+    }
+  }
+
   void print() const {
     dataset_data<VT>::print();
     dataset_attributes::print();
@@ -298,15 +1007,64 @@ struct dataset_wattr : public dataset_attributes, public dataset_data<VT> {
     dataset_attributes::read_dataset_1proc(grp, dataset_name, rank);
   }
 
+  void read_dataset_mapped(const H5::Group &grp, const std::string &dataset_name,
+                           const int rank) {
+    dataset_data<VT>::read_dataset_mapped(grp, dataset_name, rank);
+    dataset_attributes::read_dataset_1proc(grp, dataset_name, rank);
+  }
+
+  // the attributes are read right away, only the rows are deferred
+  void open_lazy(const H5::Group &grp, const std::string &dataset_name, const mpicpp::comm &comm,
+                 bool parallel) {
+    dataset_data<VT>::open_lazy(grp, dataset_name, comm, parallel);
+    if (parallel) {
+      dataset_attributes::read_dataset_parallel(grp, dataset_name, comm);
+    } else {
+      dataset_attributes::read_dataset_1proc(grp, dataset_name, comm.rank());
+      dataset_attributes::distribute_data(comm);
+    }
+  }
+
   void read_dataset_parallel(const H5::Group &grp, const std::string &dataset_name,
                              const mpicpp::comm &comm) override {
     dataset_data<VT>::read_dataset_parallel(grp, dataset_name, comm);
     dataset_attributes::read_dataset_parallel(grp, dataset_name, comm);
+    convert_units(comm);
   }
 
   void distribute_data(const mpicpp::comm &comm) override {
     dataset_data<VT>::distribute_data(comm);
     dataset_attributes::distribute_data(comm);
+    convert_units(comm);
+  }
+
+  void distribute_data_hierarchical(const mpicpp::comm &comm, const node_topology &topo) {
+    dataset_data<VT>::distribute_data_hierarchical(comm, topo);
+    dataset_attributes::distribute_data(comm);
+    convert_units(comm);
+  }
+
+  // the attributes are only read by the job, after the gather nothing modifies them
+  std::function<void(const H5::Group &)> release_write_job() {
+    return [this, data_job = dataset_data<VT>::release_write_job()](const H5::Group &grp) {
+      data_job(grp);
+      write_attributes(grp.openDataSet(this->name));
+    };
+  }
+
+  void read_dataset_pipelined(const H5::Group &grp, const std::string &dataset_name,
+                              const mpicpp::comm &comm, scatter_pipeline &pipe) {
+    dataset_data<VT>::read_dataset_pipelined(grp, dataset_name, comm, pipe);
+    dataset_attributes::read_dataset_1proc(grp, dataset_name, comm.rank());
+    dataset_attributes::distribute_data(comm);
+  }
+
+  void read_dataset_shared(const H5::Group &grp, const std::string &dataset_name,
+                           const mpicpp::comm &comm, const node_topology &topo) {
+    dataset_data<VT>::read_dataset_shared(grp, dataset_name, comm, topo);
+    dataset_attributes::read_dataset_1proc(grp, dataset_name, comm.rank());
+    dataset_attributes::distribute_data(comm);
+    convert_units(comm);
   }
 
   void write_to_file_parallel(const H5::Group &grp, const std::string &dataset_name,
@@ -320,14 +1078,50 @@ struct dataset_wattr : public dataset_attributes, public dataset_data<VT> {
     dataset_data<VT>::write_to_file_1proc(grp, dataset_name, comm);
     dataset_attributes::write_to_file_1proc(grp, dataset_name, comm);
   }
+
+  // the six unit attributes are always read by rank 0 and broadcast
+  void read_dataset_adaptive(const H5::Group &grp, const std::string &dataset_name,
+                             const mpicpp::comm &comm) {
+    dataset_data<VT>::read_dataset_adaptive(grp, dataset_name, comm);
+    dataset_attributes::read_dataset_1proc(grp, dataset_name, comm.rank());
+    dataset_attributes::distribute_data(comm);
+    convert_units(comm);
+  }
+
+  void write_to_file_adaptive(const H5::Group &grp, const std::string &dataset_name,
+                              const mpicpp::comm &comm) {
+    dataset_data<VT>::write_to_file_adaptive(grp, dataset_name, comm);
+    dataset_attributes::write_to_file_parallel(grp, dataset_name, comm);
+  }
+
+  void write_column(column_writer &out, const std::string &group, const mpicpp::comm &comm,
+                    bool parallel) {
+    dataset_data<VT>::write_column(out, group, comm, parallel);
+    if (comm.rank() == 0)
+      out.manifest.columns.back().attributes = column_attributes();
+  }
+
+  void map_column(const std::filesystem::path &dir, const column_entry &col,
+                  const mpicpp::comm &comm) {
+    dataset_data<VT>::map_column(dir, col, comm);
+    read_column_attributes(col);
+    convert_units(comm);
+  }
 };
 
+template <typename T, typename = void>
+struct has_coordinates : std::false_type {};
+
+template <typename T>
+struct has_coordinates<T, std::void_t<decltype(std::declval<T &>().Coordinates)>>
+    : std::true_type {};
+
 struct PartTypeBase {
   virtual void read_from_file_1proc(const H5::H5File &, const mpi_state &)             = 0;
   virtual void read_from_file_parallel(const H5::H5File &, const mpi_state &)          = 0;
   virtual void distribute_data(const mpicpp::comm &)                                   = 0;
   virtual void gather_data(const mpicpp::comm &)                                       = 0;
-  virtual void write_to_file_parallel(const H5::H5File &file, const mpi_state &) const = 0;
+  virtual void write_to_file_parallel(const H5::H5File &file, const mpi_state &)       = 0;
   virtual void print() const                                                           = 0;
   virtual ~PartTypeBase()                                                              = default;
 };
@@ -340,52 +1134,412 @@ struct PartTypeCommon : PartTypeBase {
 
   auto datasets() const { return static_cast<const Derived *>(this)->datasets(); }
 
+  // --derived: fields requested for this PartType, and their rows once computed. The rows
+  // follow the datasets through every exchange and write.
+  std::vector<const derived_field *> derived_requested{};
+  std::vector<std::unique_ptr<dataset_wattr<float>>> derived{};
+
+  // datasets reused by --resume or unused with --derived-only are skipped by every read,
+  // exchange and write
   template <typename F>
   void for_each_dataset(F &&f) {
-    std::apply([&](auto &...ds) { (f(ds), ...); }, datasets());
+    std::apply([&](auto &...ds) { ((ds.reuse || ds.unused ? void() : void(f(ds))), ...); },
+               datasets());
+    for (auto &ds : derived)
+      f(*ds);
   }
 
   template <typename F>
   void for_each_dataset(F &&f) const {
-    std::apply([&](auto const &...ds) { (f(ds), ...); }, datasets());
+    std::apply(
+      [&](auto const &...ds) { ((ds.reuse || ds.unused ? void() : void(f(ds))), ...); },
+      datasets());
+    for (auto const &ds : derived)
+      f(*ds);
+  }
+
+  template <typename F>
+  void for_each_dataset_all(F &&f) {
+    std::apply([&](auto &...ds) { (f(ds), ...); }, datasets());
+    for (auto &ds : derived)
+      f(*ds);
   }
 
   void read_from_file_1proc(const H5::H5File &file, const mpi_state &state) override {
     if (state.i_rank != 0)
       return;
+    scoped_timer pt_timer(Derived::group_name());
+    io_group_scope io_scope(Derived::group_name());
+    auto group = file.openGroup(Derived::group_name());
+    for_each_dataset([&](auto &ds) {
+      scoped_timer t(ds.name);
+      ds.read_dataset_1proc(group, ds.name, state.i_rank);
+    });
+  }
+
+  void read_from_file_mapped(const H5::H5File &file, const mpi_state &state) {
+    if (state.i_rank != 0)
+      return;
+    scoped_timer pt_timer(Derived::group_name());
+    io_group_scope io_scope(Derived::group_name());
     auto group = file.openGroup(Derived::group_name());
-    for_each_dataset([&](auto &ds) { ds.read_dataset_1proc(group, ds.name, state.i_rank); });
+    for_each_dataset([&](auto &ds) {
+      scoped_timer t(ds.name);
+      ds.read_dataset_mapped(group, ds.name, state.i_rank);
+    });
+  }
+
+  // --lazy: shapes and attributes only, see dataset_data::open_lazy
+  void open_lazy(const H5::H5File &file, const mpi_state &state, bool parallel) {
+    scoped_timer pt_timer(Derived::group_name());
+    io_group_scope io_scope(Derived::group_name());
+    H5::Group group;
+    if (parallel || state.i_rank == 0)
+      group = file.openGroup(Derived::group_name());
+    for_each_dataset([&](auto &ds) { ds.open_lazy(group, ds.name, state.island_comm, parallel); });
   }
 
   void read_from_file_parallel(const H5::H5File &file, const mpi_state &state) override {
+    scoped_timer pt_timer(Derived::group_name());
+    io_group_scope io_scope(Derived::group_name());
+    auto group = file.openGroup(Derived::group_name());
+    for_each_dataset([&](auto &ds) {
+      scoped_timer t(ds.name);
+      ds.read_dataset_parallel(group, ds.name, state.island_comm);
+    });
+  }
+
+  void read_from_file_adaptive(const H5::H5File &file, const mpi_state &state) {
+    scoped_timer pt_timer(Derived::group_name());
+    io_group_scope io_scope(Derived::group_name());
     auto group = file.openGroup(Derived::group_name());
-    for_each_dataset(
-      [&](auto &ds) { ds.read_dataset_parallel(group, ds.name, state.island_comm); });
+    for_each_dataset([&](auto &ds) {
+      scoped_timer t(ds.name);
+      ds.read_dataset_adaptive(group, ds.name, state.island_comm);
+    });
+  }
+
+  // the rows arrive when the caller drains `pipe`
+  void read_from_file_pipelined(const H5::H5File &file, const mpi_state &state,
+                                scatter_pipeline &pipe) {
+    scoped_timer pt_timer(Derived::group_name());
+    io_group_scope io_scope(Derived::group_name());
+    H5::Group group;
+    if (state.i_rank == 0)
+      group = file.openGroup(Derived::group_name());
+    for_each_dataset([&](auto &ds) {
+      scoped_timer t(ds.name);
+      ds.read_dataset_pipelined(group, ds.name, state.island_comm, pipe);
+    });
+  }
+
+  void read_from_file_shared(const H5::H5File &file, const mpi_state &state,
+                             const node_topology &topo) {
+    scoped_timer pt_timer(Derived::group_name());
+    io_group_scope io_scope(Derived::group_name());
+    H5::Group group;
+    if (state.i_rank == 0)
+      group = file.openGroup(Derived::group_name());
+    for_each_dataset([&](auto &ds) {
+      scoped_timer t(ds.name);
+      ds.read_dataset_shared(group, ds.name, state.island_comm, topo);
+    });
   }
 
   void distribute_data(const mpicpp::comm &comm) override {
-    for_each_dataset([&](auto &ds) { ds.distribute_data(comm); });
+    scoped_timer pt_timer(Derived::group_name());
+    io_group_scope io_scope(Derived::group_name());
+    for_each_dataset([&](auto &ds) {
+      scoped_timer t(ds.name);
+      ds.distribute_data(comm);
+    });
   }
 
   void gather_data(const mpicpp::comm &comm) override {
-    for_each_dataset([&](auto &ds) { ds.gather_data(comm); });
+    scoped_timer pt_timer(Derived::group_name());
+    io_group_scope io_scope(Derived::group_name());
+    for_each_dataset([&](auto &ds) {
+      scoped_timer t(ds.name);
+      ds.gather_data(comm);
+    });
+  }
+
+  void distribute_data_hierarchical(const mpicpp::comm &comm, const node_topology &topo) {
+    scoped_timer pt_timer(Derived::group_name());
+    io_group_scope io_scope(Derived::group_name());
+    for_each_dataset([&](auto &ds) {
+      scoped_timer t(ds.name);
+      ds.distribute_data_hierarchical(comm, topo);
+    });
+  }
+
+  void gather_data_hierarchical(const mpicpp::comm &comm, const node_topology &topo) {
+    scoped_timer pt_timer(Derived::group_name());
+    io_group_scope io_scope(Derived::group_name());
+    for_each_dataset([&](auto &ds) {
+      scoped_timer t(ds.name);
+      ds.gather_data_hierarchical(comm, topo);
+    });
+  }
+
+  void gather_data_shared(const mpicpp::comm &comm, const node_topology &topo) {
+    scoped_timer pt_timer(Derived::group_name());
+    io_group_scope io_scope(Derived::group_name());
+    for_each_dataset([&](auto &ds) {
+      scoped_timer t(ds.name);
+      ds.gather_data_shared(comm, topo);
+    });
   }
 
   void print() const override {
     for_each_dataset([](auto const &ds) { ds.print(); });
   }
 
-  void write_to_file_parallel(const H5::H5File &file, const mpi_state &state) const override {
-    auto group = file.createGroup(Derived::group_name());
-    for_each_dataset(
-      [&](auto const &ds) { ds.write_to_file_parallel(group, ds.name, state.island_comm); });
+  // --resume, collective over the island: marks the datasets `out` already holds a completed
+  // copy of, they are neither read nor written again. Stale copies are unlinked, by every rank
+  // when `out` uses the MPI-IO driver (`out_parallel`), else by island rank 0.
+  void plan_resume(const H5::H5File &in, const H5::H5File &out,
+                   const std::filesystem::path &source, const mpi_state &state,
+                   bool out_parallel) {
+    // per dataset: 0 write, 1 reuse, 2 unlink the stale copy and write
+    std::vector<int> action;
+    std::vector<std::uint64_t> prints;
+    for_each_dataset_all([&](auto &) {
+      action.push_back(0);
+      prints.push_back(0);
+    });
+    if (state.i_rank == 0) {
+      auto in_group = in.openGroup(Derived::group_name());
+      std::optional<H5::Group> out_group;
+      if (out.nameExists(Derived::group_name()))
+        out_group.emplace(out.openGroup(Derived::group_name()));
+      std::size_t i = 0;
+      for_each_dataset_all([&](auto &ds) {
+        const bool stale = ds.check_resume(in_group, out_group ? &*out_group : nullptr, source,
+                                           Derived::group_name());
+        action[i]   = ds.reuse ? 1 : stale ? 2 : 0;
+        prints[i++] = ds.fingerprint;
+      });
+    }
+    MPI_Bcast(action.data(), action.size(), MPI_INT, 0, state.island_comm.get());
+    MPI_Bcast(prints.data(), prints.size(), MPI_UINT64_T, 0, state.island_comm.get());
+    const bool unlinks = out_parallel || state.i_rank == 0;
+    std::size_t i      = 0;
+    for_each_dataset_all([&](auto &ds) {
+      ds.reuse       = action[i] == 1;
+      ds.fingerprint = prints[i];
+      if (action[i++] == 2 && unlinks)
+        out.openGroup(Derived::group_name()).unlink(ds.name);
+    });
+  }
+
+  void hash_rows(const mpicpp::comm &comm) {
+    for_each_dataset([&](auto &ds) { ds.hash_rows(comm); });
+  }
+
+  // after all rows are written, on every rank when `out_parallel`, else island rank 0
+  void stamp_resume(const H5::H5File &out, const mpi_state &state, bool out_parallel) const {
+    if (!out_parallel && state.i_rank != 0)
+      return;
+    auto group = out.openGroup(Derived::group_name());
+    for_each_dataset([&](auto const &ds) { ds.stamp_resume(group); });
+  }
+
+  void write_to_columns(column_writer &out, const mpi_state &state, bool parallel) {
+    scoped_timer pt_timer(Derived::group_name());
+    io_group_scope io_scope(Derived::group_name());
+    for_each_dataset([&](auto &ds) {
+      scoped_timer t(ds.name);
+      ds.write_column(out, Derived::group_name(), state.island_comm, parallel);
+    });
+  }
+
+  void map_from_columns(const std::filesystem::path &dir, const column_manifest &manifest,
+                        const mpi_state &state) {
+    scoped_timer pt_timer(Derived::group_name());
+    io_group_scope io_scope(Derived::group_name());
+    for_each_dataset([&](auto &ds) {
+      scoped_timer t(ds.name);
+      ds.map_column(dir, manifest.find(std::string(Derived::group_name()) + "/" + ds.name),
+                    state.island_comm);
+    });
+  }
+
+  // --id-codec: the std::uint64_t ID columns are written through the ID filter
+  void set_id_codec(bool enabled) {
+    for_each_dataset_all([&](auto &ds) {
+      using VT = typename std::decay_t<decltype(ds.data_chunk)>::value_type;
+      if constexpr (std::is_same_v<VT, std::uint64_t>)
+        ds.id_codec = enabled && is_id_column(ds.name);
+    });
+  }
+
+  // --physical-cgs: the float and double datasets with unit attributes are converted with
+  // scale factor `a` and Hubble parameter `h` as they are read, `a` of 0 keeps code units
+  void set_physical_cgs(double a, double h) {
+    for_each_dataset_all([&](auto &ds) {
+      if constexpr (std::is_base_of_v<dataset_attributes, std::decay_t<decltype(ds)>>) {
+        ds.physical_a = a;
+        ds.physical_h = h;
+      }
+    });
+  }
+
+  // --derived: keeps the fields of `fields` that belong to this PartType. With `only` every
+  // dataset that is not one of their inputs is left out.
+  void select_derived(const std::vector<const derived_field *> &fields, bool only) {
+    derived_requested.clear();
+    for (auto *field : fields) {
+      if (field->group == std::string(Derived::group_name()))
+        derived_requested.push_back(field);
+    }
+    std::apply(
+      [&](auto &...ds) {
+        ((ds.unused = only && std::none_of(derived_requested.begin(), derived_requested.end(),
+                                           [&](const derived_field *field) {
+                                             return std::find(field->inputs.begin(),
+                                                              field->inputs.end(),
+                                                              ds.name) != field->inputs.end();
+                                           })),
+         ...);
+      },
+      datasets());
+  }
+
+  // --derived, on every island rank once the inputs are read: computes the requested fields
+  // from this rank's rows, which are appended as datasets of their own
+  void compute_derived(const derived_context &ctx) {
+    derived.clear();
+    scoped_timer pt_timer(Derived::group_name());
+    for (auto *field : derived_requested) {
+      scoped_timer t(field->name);
+      std::vector<derived_input> in;
+      std::vector<hsize_t> local_dims, total_dims;
+      for (auto *input : field->inputs) {
+        bool found = false;
+        for_each_dataset_all([&](auto &ds) {
+          using DS = std::decay_t<decltype(ds)>;
+          using VT = typename std::decay_t<decltype(ds.data_chunk)>::value_type;
+          if constexpr (std::is_same_v<VT, float> && std::is_base_of_v<dataset_attributes, DS>) {
+            if (found || ds.name != input)
+              return;
+            // a lazy input stays resident while the others are read
+            ds.pin();
+            if (ds.local_dataspace_dims.size() != 1 ||
+                (!in.empty() && ds.local_dataspace_dims != local_dims))
+              throw std::runtime_error(fmt::format("derived field {}: input {} has another shape\n",
+                                                   field->name, input));
+            local_dims = ds.local_dataspace_dims;
+            total_dims = ds.total_dataspace_dims;
+            const double to_cgs = ds.units == unit_system::code
+                                    ? physical_cgs_factor(ctx.a, ctx.h, ds.a_scaling,
+                                                          ds.h_scaling, ds.to_cgs)
+                                    : cgs_factor(ds.to_cgs);
+            in.push_back({ds.rows_data(), to_cgs});
+            found = true;
+          }
+        });
+        if (!found)
+          throw std::runtime_error(fmt::format("derived field {}: {} has no float dataset {}\n",
+                                               field->name, Derived::group_name(), input));
+      }
+      auto out                      = std::make_unique<dataset_wattr<float>>(field->name);
+      out->local_dataspace_dims     = local_dims;
+      out->local_dataspace_max_dims = local_dims;
+      out->total_dataspace_dims     = total_dims;
+      out->data_chunk.resize(local_dims[0]);
+      field->compute(ctx, in.data(), out->data_chunk.data(), out->data_chunk.size());
+      out->to_cgs = field->to_cgs;
+      out->units  = field->units;
+      derived.push_back(std::move(out));
+    }
+  }
+
+  // --fixed-point-coords: Coordinates are written relative to a periodic box of side `box`
+  void set_fixed_point_box(double box) {
+    if constexpr (has_coordinates<Derived>::value)
+      static_cast<Derived *>(this)->Coordinates.fixed_point_box = box;
+  }
+
+  // sort the distributed rows of every dataset by the Peano-Hilbert key of Coordinates
+  ph_cell_offsets sort_by_peano_hilbert(const mpicpp::comm &comm, double box_size, int level) {
+    ph_cell_offsets offsets{Derived::group_name(), level};
+    if constexpr (has_coordinates<Derived>::value) {
+      for_each_dataset([](auto &ds) { ds.materialize(); });
+      auto keys = peano_hilbert_keys(static_cast<Derived *>(this)->Coordinates.data_chunk,
+                                     box_size);
+      auto order = key_sort_order(keys);
+      ::reorder_rows(keys, 1, order);
+      for_each_dataset([&](auto &ds) { ds.reorder_rows(order); });
+
+      auto send_rows = ph_partition(keys, comm);
+      ::alltoall_rows(keys, 1, send_rows, comm);
+      for_each_dataset([&](auto &ds) { ds.alltoall_rows(send_rows, comm); });
+
+      // received runs are sorted per source rank, merge them
+      order = key_sort_order(keys);
+      ::reorder_rows(keys, 1, order);
+      for_each_dataset([&](auto &ds) { ds.reorder_rows(order); });
+
+      offsets.compute(keys, comm);
+    }
+    return offsets;
+  }
+
+  // lazy datasets are read one at a time just before they are written
+  void write_to_file_parallel(const H5::H5File &file, const mpi_state &state) override {
+    scoped_timer pt_timer(Derived::group_name());
+    io_group_scope io_scope(Derived::group_name());
+    auto group = open_or_create_group(file, Derived::group_name());
+    for_each_dataset([&](auto &ds) {
+      scoped_timer t(ds.name);
+      ds.require();
+      ds.write_to_file_parallel(group, ds.name, state.island_comm);
+    });
+  }
+
+  void write_to_file_adaptive(const H5::H5File &file, const mpi_state &state) {
+    scoped_timer pt_timer(Derived::group_name());
+    io_group_scope io_scope(Derived::group_name());
+    auto group = open_or_create_group(file, Derived::group_name());
+    for_each_dataset([&](auto &ds) {
+      scoped_timer t(ds.name);
+      ds.write_to_file_adaptive(group, ds.name, state.island_comm);
+    });
+  }
+
+  // Gathers one dataset at a time while `wb` (island rank 0 only, null elsewhere) writes the
+  // previous one. The group is created and closed on the helper thread as well.
+  void write_to_file_behind(const H5::H5File &file, const mpi_state &state, write_behind *wb,
+                            const node_topology *topo) {
+    scoped_timer pt_timer(Derived::group_name());
+    io_group_scope io_scope(Derived::group_name());
+    auto group = std::make_shared<std::optional<H5::Group>>();
+    if (wb)
+      wb->submit(
+        [&file, group] { group->emplace(open_or_create_group(file, Derived::group_name())); });
+    for_each_dataset([&](auto &ds) {
+      scoped_timer t(ds.name);
+      if (topo)
+        ds.gather_data_hierarchical(state.island_comm, *topo);
+      else
+        ds.gather_data(state.island_comm);
+      if (wb)
+        wb->submit([group, job = ds.release_write_job()] { job(**group); });
+    });
+    if (wb)
+      wb->submit([group] { group->reset(); });
   }
 
   void write_to_file_1proc(const H5::H5File &file, const mpi_state &state) const {
     if (state.island_comm.rank() == 0) {
-      auto group = file.createGroup(Derived::group_name());
-      for_each_dataset(
-        [&](auto const &ds) { ds.write_to_file_1proc(group, ds.name, state.island_comm); });
+      scoped_timer pt_timer(Derived::group_name());
+      io_group_scope io_scope(Derived::group_name());
+      auto group = open_or_create_group(file, Derived::group_name());
+      for_each_dataset([&](auto const &ds) {
+        scoped_timer t(ds.name);
+        ds.write_to_file_1proc(group, ds.name, state.island_comm);
+      });
     }
   }
 };
@@ -650,22 +1804,79 @@ struct part_groups {
   std::unique_ptr<PartType3> pt3;
   std::unique_ptr<PartType4> pt4;
   std::unique_ptr<PartType5> pt5;
+  // --fixed-point-coords: box side handed to every PartType by setup, 0 for plain coordinates
+  double fixed_point_box{0.0};
+  // --id-codec: handed to every PartType by setup as well
+  bool id_codec{false};
+  // --physical-cgs: Time and HubbleParam of the header, handed out by setup, 0 for code units
+  double physical_a{0.0};
+  double physical_h{0.0};
+  // --derived: fields computed after the read, setup hands each PartType its own.
+  // --derived-only: only their inputs are read and written.
+  std::vector<const derived_field *> derived_fields{};
+  bool derived_only{false};
 
   part_groups() = default;
 
   part_groups(const header_group &hg) { setup(hg.hb); }
 
+  // keeps PartTypes that already exist, e.g. with the datasets planned by plan_resume
   void setup(const header_base &header) {
-    if (header.NumPart_Total[0] > 0)
+    if (header.NumPart_Total[0] > 0 && !pt0)
       pt0 = std::make_unique<PartType0>();
-    if (header.NumPart_Total[1] > 0)
+    if (header.NumPart_Total[1] > 0 && !pt1)
       pt1 = std::make_unique<PartType1>();
-    if (header.NumPart_Total[3] > 0)
+    if (header.NumPart_Total[3] > 0 && !pt3)
       pt3 = std::make_unique<PartType3>();
-    if (header.NumPart_Total[4] > 0)
+    if (header.NumPart_Total[4] > 0 && !pt4)
       pt4 = std::make_unique<PartType4>();
-    if (header.NumPart_Total[5] > 0)
+    if (header.NumPart_Total[5] > 0 && !pt5)
       pt5 = std::make_unique<PartType5>();
+    if (pt0) {
+      pt0->set_fixed_point_box(fixed_point_box);
+      pt0->set_id_codec(id_codec);
+      pt0->set_physical_cgs(physical_a, physical_h);
+      pt0->select_derived(derived_fields, derived_only);
+    }
+    if (pt1) {
+      pt1->set_fixed_point_box(fixed_point_box);
+      pt1->set_id_codec(id_codec);
+      pt1->set_physical_cgs(physical_a, physical_h);
+      pt1->select_derived(derived_fields, derived_only);
+    }
+    if (pt3) {
+      pt3->set_fixed_point_box(fixed_point_box);
+      pt3->set_id_codec(id_codec);
+      pt3->set_physical_cgs(physical_a, physical_h);
+      pt3->select_derived(derived_fields, derived_only);
+    }
+    if (pt4) {
+      pt4->set_fixed_point_box(fixed_point_box);
+      pt4->set_id_codec(id_codec);
+      pt4->set_physical_cgs(physical_a, physical_h);
+      pt4->select_derived(derived_fields, derived_only);
+    }
+    if (pt5) {
+      pt5->set_fixed_point_box(fixed_point_box);
+      pt5->set_id_codec(id_codec);
+      pt5->set_physical_cgs(physical_a, physical_h);
+      pt5->select_derived(derived_fields, derived_only);
+    }
+  }
+
+  // after any of the reads, collective over the island for lazy inputs
+  void compute_derived(const header_group &hg) {
+    const derived_context ctx{hg.hb.Time, hg.hb.HubbleParam, hg.hb.Omega0, hg.hb.OmegaLambda};
+    if (pt0)
+      pt0->compute_derived(ctx);
+    if (pt1)
+      pt1->compute_derived(ctx);
+    if (pt3)
+      pt3->compute_derived(ctx);
+    if (pt4)
+      pt4->compute_derived(ctx);
+    if (pt5)
+      pt5->compute_derived(ctx);
   }
 
   void read_from_file_1proc(const H5::H5File &file, const mpi_state &state,
@@ -683,6 +1894,36 @@ struct part_groups {
       pt5->read_from_file_1proc(file, state);
   }
 
+  void read_from_file_mapped(const H5::H5File &file, const mpi_state &state,
+                            const header_group &hg) {
+    setup(hg.hb);
+    if (pt0)
+      pt0->read_from_file_mapped(file, state);
+    if (pt1)
+      pt1->read_from_file_mapped(file, state);
+    if (pt3)
+      pt3->read_from_file_mapped(file, state);
+    if (pt4)
+      pt4->read_from_file_mapped(file, state);
+    if (pt5)
+      pt5->read_from_file_mapped(file, state);
+  }
+
+  void open_lazy(const H5::H5File &file, const mpi_state &state, const header_group &hg,
+                 bool parallel) {
+    setup(hg.hb);
+    if (pt0)
+      pt0->open_lazy(file, state, parallel);
+    if (pt1)
+      pt1->open_lazy(file, state, parallel);
+    if (pt3)
+      pt3->open_lazy(file, state, parallel);
+    if (pt4)
+      pt4->open_lazy(file, state, parallel);
+    if (pt5)
+      pt5->open_lazy(file, state, parallel);
+  }
+
   void read_from_file_parallel(const H5::H5File &file, const mpi_state &state,
                                const header_group &hg) {
     setup(hg.hb);
@@ -698,6 +1939,51 @@ struct part_groups {
       pt5->read_from_file_parallel(file, state);
   }
 
+  void read_from_file_adaptive(const H5::H5File &file, const mpi_state &state,
+                               const header_group &hg) {
+    setup(hg.hb);
+    if (pt0)
+      pt0->read_from_file_adaptive(file, state);
+    if (pt1)
+      pt1->read_from_file_adaptive(file, state);
+    if (pt3)
+      pt3->read_from_file_adaptive(file, state);
+    if (pt4)
+      pt4->read_from_file_adaptive(file, state);
+    if (pt5)
+      pt5->read_from_file_adaptive(file, state);
+  }
+
+  void read_from_file_pipelined(const H5::H5File &file, const mpi_state &state,
+                                const header_group &hg, scatter_pipeline &pipe) {
+    setup(hg.hb);
+    if (pt0)
+      pt0->read_from_file_pipelined(file, state, pipe);
+    if (pt1)
+      pt1->read_from_file_pipelined(file, state, pipe);
+    if (pt3)
+      pt3->read_from_file_pipelined(file, state, pipe);
+    if (pt4)
+      pt4->read_from_file_pipelined(file, state, pipe);
+    if (pt5)
+      pt5->read_from_file_pipelined(file, state, pipe);
+  }
+
+  void read_from_file_shared(const H5::H5File &file, const mpi_state &state,
+                             const header_group &hg, const node_topology &topo) {
+    setup(hg.hb);
+    if (pt0)
+      pt0->read_from_file_shared(file, state, topo);
+    if (pt1)
+      pt1->read_from_file_shared(file, state, topo);
+    if (pt3)
+      pt3->read_from_file_shared(file, state, topo);
+    if (pt4)
+      pt4->read_from_file_shared(file, state, topo);
+    if (pt5)
+      pt5->read_from_file_shared(file, state, topo);
+  }
+
   void distribute_data(const mpicpp::comm &comm) {
     if (pt0)
       pt0->distribute_data(comm);
@@ -724,7 +2010,46 @@ struct part_groups {
       pt5->gather_data(comm);
   }
 
-  void write_to_file_parallel(const H5::H5File &file, const mpi_state &state) const {
+  void distribute_data_hierarchical(const mpicpp::comm &comm, const node_topology &topo) {
+    if (pt0)
+      pt0->distribute_data_hierarchical(comm, topo);
+    if (pt1)
+      pt1->distribute_data_hierarchical(comm, topo);
+    if (pt3)
+      pt3->distribute_data_hierarchical(comm, topo);
+    if (pt4)
+      pt4->distribute_data_hierarchical(comm, topo);
+    if (pt5)
+      pt5->distribute_data_hierarchical(comm, topo);
+  }
+
+  void gather_data_hierarchical(const mpicpp::comm &comm, const node_topology &topo) {
+    if (pt0)
+      pt0->gather_data_hierarchical(comm, topo);
+    if (pt1)
+      pt1->gather_data_hierarchical(comm, topo);
+    if (pt3)
+      pt3->gather_data_hierarchical(comm, topo);
+    if (pt4)
+      pt4->gather_data_hierarchical(comm, topo);
+    if (pt5)
+      pt5->gather_data_hierarchical(comm, topo);
+  }
+
+  void gather_data_shared(const mpicpp::comm &comm, const node_topology &topo) {
+    if (pt0)
+      pt0->gather_data_shared(comm, topo);
+    if (pt1)
+      pt1->gather_data_shared(comm, topo);
+    if (pt3)
+      pt3->gather_data_shared(comm, topo);
+    if (pt4)
+      pt4->gather_data_shared(comm, topo);
+    if (pt5)
+      pt5->gather_data_shared(comm, topo);
+  }
+
+  void write_to_file_parallel(const H5::H5File &file, const mpi_state &state) {
     if (pt0)
       pt0->write_to_file_parallel(file, state);
     if (pt1)
@@ -737,6 +2062,33 @@ struct part_groups {
       pt5->write_to_file_parallel(file, state);
   }
 
+  void write_to_file_adaptive(const H5::H5File &file, const mpi_state &state) {
+    if (pt0)
+      pt0->write_to_file_adaptive(file, state);
+    if (pt1)
+      pt1->write_to_file_adaptive(file, state);
+    if (pt3)
+      pt3->write_to_file_adaptive(file, state);
+    if (pt4)
+      pt4->write_to_file_adaptive(file, state);
+    if (pt5)
+      pt5->write_to_file_adaptive(file, state);
+  }
+
+  void write_to_file_behind(const H5::H5File &file, const mpi_state &state, write_behind *wb,
+                            const node_topology *topo) {
+    if (pt0)
+      pt0->write_to_file_behind(file, state, wb, topo);
+    if (pt1)
+      pt1->write_to_file_behind(file, state, wb, topo);
+    if (pt3)
+      pt3->write_to_file_behind(file, state, wb, topo);
+    if (pt4)
+      pt4->write_to_file_behind(file, state, wb, topo);
+    if (pt5)
+      pt5->write_to_file_behind(file, state, wb, topo);
+  }
+
   void write_to_file_1proc(H5::H5File &file, const mpi_state &state) const {
     if (pt0)
       pt0->write_to_file_1proc(file, state);
@@ -750,6 +2102,92 @@ struct part_groups {
       pt5->write_to_file_1proc(file, state);
   }
 
+  // --columnar-out, collective over the island
+  void write_to_columns(column_writer &out, const mpi_state &state, bool parallel) {
+    if (pt0)
+      pt0->write_to_columns(out, state, parallel);
+    if (pt1)
+      pt1->write_to_columns(out, state, parallel);
+    if (pt3)
+      pt3->write_to_columns(out, state, parallel);
+    if (pt4)
+      pt4->write_to_columns(out, state, parallel);
+    if (pt5)
+      pt5->write_to_columns(out, state, parallel);
+  }
+
+  // --columnar-in: every rank maps its rows of the snapshot in `dir`, nothing is scattered
+  void map_from_columns(const std::filesystem::path &dir, const column_manifest &manifest,
+                        const mpi_state &state, const header_group &hg) {
+    setup(hg.hb);
+    if (pt0)
+      pt0->map_from_columns(dir, manifest, state);
+    if (pt1)
+      pt1->map_from_columns(dir, manifest, state);
+    if (pt3)
+      pt3->map_from_columns(dir, manifest, state);
+    if (pt4)
+      pt4->map_from_columns(dir, manifest, state);
+    if (pt5)
+      pt5->map_from_columns(dir, manifest, state);
+  }
+
+  void plan_resume(const H5::H5File &in, const H5::H5File &out,
+                   const std::filesystem::path &source, const mpi_state &state,
+                   const header_group &hg, bool out_parallel) {
+    setup(hg.hb);
+    if (pt0)
+      pt0->plan_resume(in, out, source, state, out_parallel);
+    if (pt1)
+      pt1->plan_resume(in, out, source, state, out_parallel);
+    if (pt3)
+      pt3->plan_resume(in, out, source, state, out_parallel);
+    if (pt4)
+      pt4->plan_resume(in, out, source, state, out_parallel);
+    if (pt5)
+      pt5->plan_resume(in, out, source, state, out_parallel);
+  }
+
+  void hash_rows(const mpicpp::comm &comm) {
+    if (pt0)
+      pt0->hash_rows(comm);
+    if (pt1)
+      pt1->hash_rows(comm);
+    if (pt3)
+      pt3->hash_rows(comm);
+    if (pt4)
+      pt4->hash_rows(comm);
+    if (pt5)
+      pt5->hash_rows(comm);
+  }
+
+  void stamp_resume(const H5::H5File &out, const mpi_state &state, bool out_parallel) const {
+    if (pt0)
+      pt0->stamp_resume(out, state, out_parallel);
+    if (pt1)
+      pt1->stamp_resume(out, state, out_parallel);
+    if (pt3)
+      pt3->stamp_resume(out, state, out_parallel);
+    if (pt4)
+      pt4->stamp_resume(out, state, out_parallel);
+    if (pt5)
+      pt5->stamp_resume(out, state, out_parallel);
+  }
+
+  std::vector<ph_cell_offsets> sort_by_peano_hilbert(const mpicpp::comm &comm, double box_size,
+                                                     int level) {
+    std::vector<ph_cell_offsets> offsets;
+    if (pt0)
+      offsets.push_back(pt0->sort_by_peano_hilbert(comm, box_size, level));
+    if (pt1)
+      offsets.push_back(pt1->sort_by_peano_hilbert(comm, box_size, level));
+    if (pt4)
+      offsets.push_back(pt4->sort_by_peano_hilbert(comm, box_size, level));
+    if (pt5)
+      offsets.push_back(pt5->sort_by_peano_hilbert(comm, box_size, level));
+    return offsets;
+  }
+
   void print() {
     if (pt0)
       pt0->print();
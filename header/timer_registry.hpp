@@ -0,0 +1,314 @@
+#pragma once
+
+#include "mem_stats.hpp"
+
+#include <fmt/format.h>
+#include <fmt/ranges.h>
+#include <mpi.h>
+#include <mpicpp.hpp>
+
+#include <algorithm>
+#include <limits>
+#include <map>
+#include <set>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Names recorded on some ranks only (e.g. serial reads on island rank 0) are merged so every
+// rank reduces the same list; rank 0 keeps first-seen order with its own names first.
+inline std::vector<std::string> union_of_names(const std::vector<std::string> &order,
+                                               const mpicpp::comm &comm) {
+  std::string local;
+  for (auto const &name : order) {
+    local += name;
+    local += '\n';
+  }
+  const int size = comm.size();
+  int len = static_cast<int>(local.size());
+  std::vector<int> lens(size), disps(size, 0);
+  MPI_Gather(&len, 1, MPI_INT, lens.data(), 1, MPI_INT, 0, comm.get());
+  for (int i = 1; i < size; ++i) {
+    disps[i] = disps[i - 1] + lens[i - 1];
+  }
+  std::string all(comm.rank() == 0 ? disps[size - 1] + lens[size - 1] : 0, '\0');
+  MPI_Gatherv(local.data(), len, MPI_CHAR, all.data(), lens.data(), disps.data(), MPI_CHAR, 0,
+              comm.get());
+
+  std::string merged;
+  if (comm.rank() == 0) {
+    std::set<std::string> seen;
+    std::istringstream in(all);
+    for (std::string name; std::getline(in, name);) {
+      if (seen.insert(name).second) {
+        merged += name;
+        merged += '\n';
+      }
+    }
+  }
+  int merged_len = static_cast<int>(merged.size());
+  MPI_Bcast(&merged_len, 1, MPI_INT, 0, comm.get());
+  merged.resize(merged_len);
+  MPI_Bcast(merged.data(), merged_len, MPI_CHAR, 0, comm.get());
+
+  std::vector<std::string> names;
+  std::istringstream in(merged);
+  for (std::string name; std::getline(in, name);) {
+    names.push_back(name);
+  }
+  return names;
+}
+
+// accumulated wall time of one named (possibly nested) phase on this rank
+struct timer_entry {
+  double seconds{0.0};
+  std::size_t calls{0};
+  // with track_memory, the largest resident set and particle buffer bytes over all calls
+  std::size_t rss_peak{0};
+  std::size_t buffer_peak{0};
+};
+
+// a phase after reduction over all ranks, `ranks` is how many ranks recorded it
+struct reduced_timer {
+  std::string name{};
+  double min{0.0};
+  double max{0.0};
+  double avg{0.0};
+  int ranks{0};
+};
+
+// min/max/sum over ranks of one per-rank quantity, ranks that did not record it are left out
+struct rank_range {
+  double min{0.0};
+  double max{0.0};
+  double sum{0.0};
+};
+
+// peak memory of a phase after reduction over all ranks, MiB
+struct reduced_memory {
+  std::string name{};
+  rank_range rss{};
+  rank_range buffers{};
+};
+
+// Named wall-clock timers. Nested timers are recorded as "outer/inner".
+// Nothing is communicated until reduce() is called once at the end.
+struct timer_registry {
+  // timers nested deeper than this are not recorded, 0 means unlimited
+  int max_depth{0};
+  // if set, every top-level phase ends with a barrier so phases do not overlap across ranks
+  MPI_Comm phase_barrier{MPI_COMM_NULL};
+  // every phase also records the peak resident set size and particle buffer bytes of this rank
+  bool track_memory{false};
+
+  std::map<std::string, timer_entry> entries{};
+  std::vector<std::string> order{};
+
+  void start(const std::string &name) {
+    std::string path = stack.empty() ? name : stack.back().path + "/" + name;
+    if (recorded(stack.size() + 1)) {
+      // reports list phases in the order they were entered
+      if (entries.try_emplace(path).second)
+        order.push_back(path);
+    }
+    if (track_memory) {
+      // the enclosing phases keep what was reached so far, the new phase starts from now
+      sample_memory();
+      rss_resettable = reset_peak_rss();
+    }
+    stack.push_back({std::move(path), MPI_Wtime()});
+  }
+
+  void stop() {
+    const double elapsed = MPI_Wtime() - stack.back().t0;
+    if (track_memory)
+      sample_memory();
+    auto f = std::move(stack.back());
+    if (recorded(stack.size())) {
+      add(f.path, elapsed);
+      if (track_memory) {
+        auto &e       = entries[f.path];
+        e.rss_peak    = std::max(e.rss_peak, f.rss_peak);
+        e.buffer_peak = std::max(e.buffer_peak, f.buffer_peak);
+      }
+    }
+    stack.pop_back();
+    if (stack.empty() && phase_barrier != MPI_COMM_NULL) {
+      MPI_Barrier(phase_barrier);
+    }
+  }
+
+  // time a callable and hand back its result, e.g. a file handle
+  template <typename F>
+  decltype(auto) measure(const std::string &name, F &&f) {
+    struct guard {
+      timer_registry &reg;
+      ~guard() { reg.stop(); }
+    };
+    start(name);
+    guard g{*this};
+    return f();
+  }
+
+  void add(const std::string &path, double seconds) {
+    auto [it, inserted] = entries.try_emplace(path);
+    if (inserted)
+      order.push_back(path);
+    it->second.seconds += seconds;
+    ++it->second.calls;
+  }
+
+  void clear() {
+    entries.clear();
+    order.clear();
+  }
+
+  // collective over comm, result is only valid on rank 0
+  std::vector<reduced_memory> reduce_memory(const mpicpp::comm &comm) const {
+    auto names           = union_of_names(order, comm);
+    const int n          = static_cast<int>(names.size());
+    constexpr double mib = 1 << 20;
+    // resident set followed by buffer bytes
+    std::vector<double> mins(2 * n, std::numeric_limits<double>::infinity());
+    std::vector<double> maxs(2 * n, 0.0);
+    std::vector<double> sums(2 * n, 0.0);
+    for (int i = 0; i < n; ++i) {
+      auto it = entries.find(names[i]);
+      if (it == entries.end())
+        continue;
+      mins[i] = maxs[i] = sums[i] = it->second.rss_peak / mib;
+      mins[n + i] = maxs[n + i] = sums[n + i] = it->second.buffer_peak / mib;
+    }
+    const bool root = comm.rank() == 0;
+    MPI_Reduce(root ? MPI_IN_PLACE : mins.data(), mins.data(), 2 * n, MPI_DOUBLE, MPI_MIN, 0,
+               comm.get());
+    MPI_Reduce(root ? MPI_IN_PLACE : maxs.data(), maxs.data(), 2 * n, MPI_DOUBLE, MPI_MAX, 0,
+               comm.get());
+    MPI_Reduce(root ? MPI_IN_PLACE : sums.data(), sums.data(), 2 * n, MPI_DOUBLE, MPI_SUM, 0,
+               comm.get());
+
+    std::vector<reduced_memory> out;
+    if (!root)
+      return out;
+    for (int i = 0; i < n; ++i) {
+      out.push_back({names[i], {mins[i], maxs[i], sums[i]},
+                     {mins[n + i], maxs[n + i], sums[n + i]}});
+    }
+    return out;
+  }
+
+  // collective over comm, result is only valid on rank 0
+  std::vector<reduced_timer> reduce(const mpicpp::comm &comm) const {
+    auto names = union_of_names(order, comm);
+    const int n = static_cast<int>(names.size());
+    std::vector<double> mins(n, std::numeric_limits<double>::infinity());
+    std::vector<double> maxs(n, -std::numeric_limits<double>::infinity());
+    std::vector<double> sums(2 * n, 0.0);  // seconds followed by rank counts
+    for (int i = 0; i < n; ++i) {
+      auto it = entries.find(names[i]);
+      if (it == entries.end())
+        continue;
+      mins[i] = maxs[i] = sums[i] = it->second.seconds;
+      sums[n + i] = 1.0;
+    }
+    const bool root = comm.rank() == 0;
+    MPI_Reduce(root ? MPI_IN_PLACE : mins.data(), mins.data(), n, MPI_DOUBLE, MPI_MIN, 0,
+               comm.get());
+    MPI_Reduce(root ? MPI_IN_PLACE : maxs.data(), maxs.data(), n, MPI_DOUBLE, MPI_MAX, 0,
+               comm.get());
+    MPI_Reduce(root ? MPI_IN_PLACE : sums.data(), sums.data(), 2 * n, MPI_DOUBLE, MPI_SUM, 0,
+               comm.get());
+
+    std::vector<reduced_timer> out;
+    if (!root)
+      return out;
+    for (int i = 0; i < n; ++i) {
+      const int ranks = static_cast<int>(sums[n + i]);
+      out.push_back({names[i], mins[i], maxs[i], sums[i] / ranks, ranks});
+    }
+    return out;
+  }
+
+private:
+  struct frame {
+    std::string path;
+    double t0;
+    std::size_t rss_peak{0};
+    std::size_t buffer_peak{0};
+  };
+  std::vector<frame> stack{};
+  // without a resettable VmHWM the resident set is only sampled at phase boundaries
+  bool rss_resettable{false};
+
+  // folds the memory reached since the last reset into every open phase
+  void sample_memory() {
+    const std::size_t rss = rss_resettable ? peak_rss_bytes() : current_rss_bytes();
+    const std::size_t buf = global_buffers().bytes();
+    for (auto &f : stack) {
+      f.rss_peak    = std::max(f.rss_peak, rss);
+      f.buffer_peak = std::max(f.buffer_peak, buf);
+    }
+  }
+
+  bool recorded(std::size_t depth) const {
+    return max_depth == 0 || depth <= static_cast<std::size_t>(max_depth);
+  }
+};
+
+inline timer_registry &global_timers() {
+  static timer_registry reg;
+  return reg;
+}
+
+struct scoped_timer {
+  timer_registry &reg;
+
+  explicit scoped_timer(const std::string &name, timer_registry &reg_ = global_timers())
+      : reg(reg_) {
+    reg.start(name);
+  }
+
+  scoped_timer(const scoped_timer &)            = delete;
+  scoped_timer &operator=(const scoped_timer &) = delete;
+
+  ~scoped_timer() { reg.stop(); }
+};
+
+using report_meta = std::vector<std::pair<std::string, std::string>>;
+
+// header line plus one value line, every phase gives <name>_min,<name>_max,<name>_avg
+inline void print_timers_csv(const std::vector<reduced_timer> &timers, const report_meta &meta = {},
+                             bool with_header = true) {
+  std::vector<std::string> cols, vals;
+  for (auto const &[key, value] : meta) {
+    cols.push_back(key);
+    vals.push_back(value);
+  }
+  for (auto const &t : timers) {
+    for (auto [suffix, v] : {std::pair{"min", t.min}, std::pair{"max", t.max}, std::pair{"avg", t.avg}}) {
+      cols.push_back(fmt::format("{}_{}", t.name, suffix));
+      vals.push_back(fmt::format("{:.6f}", v));
+    }
+  }
+  if (with_header)
+    fmt::print("{}\n", fmt::join(cols, ","));
+  fmt::print("{}\n", fmt::join(vals, ","));
+}
+
+inline void print_timers_json(const std::vector<reduced_timer> &timers,
+                              const report_meta &meta = {}) {
+  fmt::print("{{\n  \"meta\": {{");
+  for (std::size_t i = 0; i < meta.size(); ++i) {
+    fmt::print("{}\n    \"{}\": \"{}\"", i ? "," : "", meta[i].first, meta[i].second);
+  }
+  fmt::print("\n  }},\n  \"timers\": [");
+  for (std::size_t i = 0; i < timers.size(); ++i) {
+    auto const &t = timers[i];
+    fmt::print(
+      "{}\n    {{\"name\": \"{}\", \"min\": {:.6f}, \"max\": {:.6f}, \"avg\": {:.6f}, "
+      "\"ranks\": {}}}",
+      i ? "," : "", t.name, t.min, t.max, t.avg, t.ranks);
+  }
+  fmt::print("\n  ]\n}}\n");
+}
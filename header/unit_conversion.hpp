@@ -0,0 +1,58 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// --physical-cgs: every float and double dataset is converted from comoving code units to
+// physical CGS right after its rows arrive on the rank, by the factor a^a_scaling h^h_scaling
+// to_cgs of its unit attributes with a = Time and h = HubbleParam of the header. A to_cgs of 0
+// (dimensionless or unknown) leaves the CGS step out. Converted datasets carry
+// unit_system_attribute and unit attributes that describe the new values: a_scaling and
+// h_scaling 0, to_cgs 1 where it was set. Values that would overflow their type in CGS (float
+// masses in grams) get the a and h part only and keep to_cgs as the factor still left to CGS.
+
+enum class unit_system : std::uint8_t { code, physical_cgs };
+
+// name of the dataset attribute marking converted rows, its value is unit_system_name()
+constexpr const char *unit_system_attribute = "unit_system";
+
+inline const char *unit_system_name(unit_system units) {
+  return units == unit_system::physical_cgs ? "physical_cgs" : "code";
+}
+
+inline unit_system parse_unit_system(const std::string &name) {
+  return name == "physical_cgs" ? unit_system::physical_cgs : unit_system::code;
+}
+
+// comoving to physical, a^a_scaling h^h_scaling
+inline double physical_factor(double a, double h, double a_scaling, double h_scaling) {
+  return std::pow(a, a_scaling) * std::pow(h, h_scaling);
+}
+
+// physical to CGS, 1 for a to_cgs of 0
+inline double cgs_factor(double to_cgs) { return to_cgs != 0.0 ? to_cgs : 1.0; }
+
+inline double physical_cgs_factor(double a, double h, double a_scaling, double h_scaling,
+                                  double to_cgs) {
+  return physical_factor(a, h, a_scaling, h_scaling) * cgs_factor(to_cgs);
+}
+
+// largest magnitude of `n` values, to check that a factor keeps them finite
+template <typename VT>
+double max_magnitude(const VT *x, std::size_t n) {
+  VT m = 0;
+  for (std::size_t i = 0; i < n; ++i)
+    m = std::max(m, std::abs(x[i]));
+  return static_cast<double>(m);
+}
+
+// out[i] = in[i] * factor, in place when `in` == `out`. The product is formed in double and
+// rounded once, the loop has no dependencies and vectorizes for float and double alike.
+template <typename VT>
+void scale_values(const VT *in, VT *out, std::size_t n, double factor) {
+  for (std::size_t i = 0; i < n; ++i)
+    out[i] = static_cast<VT>(static_cast<double>(in[i]) * factor);
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <utility>
+
+// Helper thread of island rank 0's serial writer. It owns every HDF5 call from the first
+// submit() to drain(), so the main thread can gather the next dataset (MPI only) meanwhile.
+// At most one job is queued or running: root holds the dataset being written plus the one
+// being gathered, not the whole file. The helper never calls MPI, not even MPI_Wtime: traces
+// and timings taken on it use std::chrono. The process needs MPI_THREAD_FUNNELED, see
+// mpi_environment.
+struct write_behind {
+  std::mutex mutex{};
+  std::condition_variable cv{};
+  std::function<void()> job{};
+  bool busy{false};
+  bool stop{false};
+  std::exception_ptr error{};
+  std::thread worker;
+
+  write_behind() : worker([this] { run(); }) {}
+
+  write_behind(const write_behind &)            = delete;
+  write_behind &operator=(const write_behind &) = delete;
+
+  ~write_behind() {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      stop = true;
+    }
+    cv.notify_all();
+    worker.join();
+  }
+
+  // blocks until the previous job is done, rethrows its exception
+  void submit(std::function<void()> f) {
+    std::unique_lock<std::mutex> lock(mutex);
+    cv.wait(lock, [&] { return !busy; });
+    rethrow();
+    job  = std::move(f);
+    busy = true;
+    cv.notify_all();
+  }
+
+  void drain() {
+    std::unique_lock<std::mutex> lock(mutex);
+    cv.wait(lock, [&] { return !busy; });
+    rethrow();
+  }
+
+private:
+  void rethrow() {
+    if (error)
+      std::rethrow_exception(std::exchange(error, nullptr));
+  }
+
+  void run() {
+    std::unique_lock<std::mutex> lock(mutex);
+    for (;;) {
+      cv.wait(lock, [&] { return busy || stop; });
+      if (!busy)
+        return;
+      auto f = std::move(job);
+      lock.unlock();
+      std::exception_ptr failed;
+      try {
+        f();
+      } catch (...) {
+        failed = std::current_exception();
+      }
+      // captured HDF5 handles are closed here, on this thread
+      f = nullptr;
+      lock.lock();
+      if (failed)
+        error = failed;
+      busy = false;
+      cv.notify_all();
+    }
+  }
+};
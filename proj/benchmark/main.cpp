@@ -1,148 +1,451 @@
 #include "main.hpp"
 #include <fmt/format.h>
 #include <mpicpp.hpp>
+#include "bench_stats.hpp"
+#include "columnar_snapshot.hpp"
+#include "file_dispenser.hpp"
+#include "file_staging.hpp"
 #include "general_utils.hpp"
 #include "hdf5_utils.hpp"
+#include "io_stats.hpp"
+#include "io_trace_pmpi.hpp"
+#include "lazy_cache.hpp"
+#include "mpio_report.hpp"
 #include "mpi_helpers.hpp"
+#include "node_topology.hpp"
+#include "scatter_pipeline.hpp"
 #include "snap_io.hpp"
+#include "timer_registry.hpp"
+#include "write_behind.hpp"
 
-int main(int argc, char **argv) try {
-  H5::Exception::dontPrint();
-  auto in_files_dir = parser(argc, argv);
-  int numfiles      = count_hdf5_files(in_files_dir);
-  mpicpp::environment env(&argc, &argv);
-  mpi_state state(numfiles);
-
-  std::filesystem::path p(argv[0]);
-  const auto out_dirname = fmt::format("out_{}", p.filename().string());
-  auto out_file_dir = create_out_files_dir(in_files_dir, state, out_dirname);
+#include <algorithm>
+#include <memory>
+#include <optional>
 
+// one full read + write of the island's current file (state.i_file), phases are recorded in
+// global_timers(); `topo` selects the node-aware scatter/gather of the serial modes, flat when null
+void run_once(const mpi_state &state, const std::filesystem::path &in_files_dir,
+              const std::filesystem::path &out_file_dir, const bench_options &opts,
+              const node_topology *topo, const H5::FileAccPropList &fapl) {
   header_group header;
   param_group params;
   config_group dconfig;
   part_groups parts;
 
-  BENCHMARK_VARS;
+  auto &timers = global_timers();
 
 // --------------------
 // Read
 // --------------------
-#ifdef READ_PARALLEL
-  BENCHMARK(para_read_fopen, state,
-            auto in_file = create_parallel_file_handle(in_files_dir, state,
-                                                       H5F_ACC_RDONLY););
+  // --columnar-in reads a directory of raw columns, there is no HDF5 input to open
+  H5::H5File in_file;
+  if (!opts.columnar_in) {
+#if defined(READ_PARALLEL) || defined(ADAPTIVE_IO)
+    in_file = timers.measure("para_read_fopen", [&] {
+      return create_parallel_file_handle(in_files_dir, state, H5F_ACC_RDONLY, fapl);
+    });
 #else
-  BENCHMARK(seri_read_fopen, state,
-            auto in_file =
-              create_serial_file_handle(in_files_dir, state, H5F_ACC_RDONLY););
+    in_file = timers.measure("seri_read_fopen", [&] {
+      return create_serial_file_handle(in_files_dir, state, H5F_ACC_RDONLY);
+    });
 #endif
+  }
 
   // --------------------
   // Output file handle
   // --------------------
-#ifdef WRITE_PARALLEL
-  BENCHMARK(para_write_fopen, state,
-            auto outfile_hand =
-              create_parallel_file_handle(out_file_dir, state, H5F_ACC_TRUNC););
+#if defined(WRITE_PARALLEL) || defined(ADAPTIVE_IO)
+  const bool out_parallel = true;
 #else
-  BENCHMARK(seri_write_fopen, state,
-            auto outfile_hand =
-              create_serial_file_handle(out_file_dir, state, H5F_ACC_TRUNC););
+  const bool out_parallel = false;
 #endif
+  // --columnar-out writes a directory of raw columns instead
+  H5::H5File outfile_hand;
+  if (!opts.columnar_out) {
+#if defined(WRITE_PARALLEL) || defined(ADAPTIVE_IO)
+    outfile_hand = timers.measure("para_write_fopen", [&] {
+      return create_parallel_file_handle(out_file_dir, state, H5F_ACC_TRUNC, fapl);
+    });
+#else
+    outfile_hand = timers.measure("seri_write_fopen", [&] {
+      return create_serial_file_handle(out_file_dir, state, H5F_ACC_TRUNC);
+    });
+#endif
+  }
 
 
-#ifdef READ_PARALLEL
-  BENCHMARK(para_read_headers, state, {
+  std::optional<column_manifest> columns_in;
+  if (opts.columnar_in) {
+    // one manifest broadcast, the attribute groups are read from its image
+    scoped_timer t("col_read_manifest");
+    columns_in.emplace(
+      read_manifest(snap_columns_path(in_files_dir, state.i_file), state.island_comm));
+    auto groups = columns_in->open_groups();
+    header.read_from_file_parallel(groups);
+    params.read_from_file_parallel(groups);
+    dconfig.read_from_file_parallel(groups);
+  } else if (opts.stage_headers) {
+    // one image broadcast, then every rank reads the attributes from memory
+    scoped_timer t("stage_headers");
+    auto staged =
+      stage_groups(in_file, {"/Header", "/Config", "/Parameters"}, state.island_comm);
+    header.read_from_file_parallel(staged);
+    params.read_from_file_parallel(staged);
+    dconfig.read_from_file_parallel(staged);
+  } else {
+#if defined(READ_PARALLEL) && !defined(ADAPTIVE_IO)
+    scoped_timer t("para_read_headers");
     header.read_from_file_parallel(in_file);
     params.read_from_file_parallel(in_file);
     dconfig.read_from_file_parallel(in_file);
-  });
+#else
+    // attribute groups are tiny: rank 0 reads, then broadcast
+    {
+      scoped_timer t("seri_read_headers");
+      header.read_from_file_1proc(in_file, state);
+      params.read_from_file_1proc(in_file, state);
+      dconfig.read_from_file_1proc(in_file, state);
+    }
 
-  BENCHMARK(para_read_parts, state,
+    {
+      scoped_timer t("distribute_header");
+      header.distribute_data(state.island_comm);
+      params.distribute_data(state.island_comm);
+      dconfig.distribute_data(state.island_comm);
+    }
+#endif
+  }
+
+  if (opts.fixed_point_coords)
+    parts.fixed_point_box = header.hb.BoxSize;
+  parts.id_codec = opts.id_codec;
+  if (opts.physical_cgs) {
+    parts.physical_a = header.hb.Time;
+    parts.physical_h = header.hb.HubbleParam;
+  }
+  parts.derived_fields = parse_derived_fields(opts.derived);
+  parts.derived_only   = opts.derived_only;
 
-            { parts.read_from_file_parallel(in_file, state, header); });
+#if defined(READ_PARALLEL) || defined(ADAPTIVE_IO)
+  const bool read_parallel = true;
 #else
-  BENCHMARK(seri_read_headers, state, {
-    header.read_from_file_1proc(in_file, state);
-    params.read_from_file_1proc(in_file, state);
-    dconfig.read_from_file_1proc(in_file, state);
-  });
-
-  BENCHMARK(distribute_header, state, {
-    header.distribute_data(state.island_comm);
-    params.distribute_data(state.island_comm);
-    dconfig.distribute_data(state.island_comm);
-  });
-
-  BENCHMARK(seri_read_parts, state,
-            parts.read_from_file_1proc(in_file, state, header););
-
-  BENCHMARK(distribute_parts, state,
-            { parts.distribute_data(state.island_comm); });
+  const bool read_parallel = false;
 #endif
+  if (opts.columnar_in) {
+    // nothing is read here, the pages are faulted in by the gather or write phases
+    scoped_timer t("col_map_parts");
+    parts.map_from_columns(snap_columns_path(in_files_dir, state.i_file), *columns_in, state,
+                           header);
+  } else if (opts.lazy) {
+    // shapes and attributes only, the rows are read in the gather or write phases
+    scoped_timer t("lazy_open_parts");
+    parts.open_lazy(in_file, state, header, read_parallel);
+  } else {
+#if defined(ADAPTIVE_IO)
+    {
+      scoped_timer t("adaptive_read_parts");
+      parts.read_from_file_adaptive(in_file, state, header);
+    }
+#elif defined(READ_PARALLEL)
+    {
+      scoped_timer t("para_read_parts");
+      parts.read_from_file_parallel(in_file, state, header);
+    }
+#else
+    if (opts.shared_memory) {
+      scoped_timer t("shm_read_parts");
+      parts.read_from_file_shared(in_file, state, header, *topo);
+    } else if (opts.pipeline > 0) {
+      scoped_timer t("pipe_read_parts");
+      scatter_pipeline pipe(opts.pipeline);
+      parts.read_from_file_pipelined(in_file, state, header, pipe);
+      pipe.drain();
+    } else {
+      if (opts.mmap) {
+        scoped_timer t("mmap_read_parts");
+        parts.read_from_file_mapped(in_file, state, header);
+      } else {
+        scoped_timer t("seri_read_parts");
+        parts.read_from_file_1proc(in_file, state, header);
+      }
+
+      {
+        scoped_timer t("distribute_parts");
+        if (topo)
+          parts.distribute_data_hierarchical(state.island_comm, *topo);
+        else
+          parts.distribute_data(state.island_comm);
+      }
+    }
+#endif
+  }
 
+  if (!parts.derived_fields.empty()) {
+    scoped_timer t("derive_parts");
+    parts.compute_derived(header);
+  }
+
+  if (opts.columnar_out) {
+    column_writer out(snap_columns_path(out_file_dir, state.i_file), state.island_comm);
+    {
+      // the serial variants gather first, inside this phase
+      scoped_timer t("col_write_parts");
+      parts.write_to_columns(out, state, out_parallel);
+    }
+    {
+      scoped_timer t("col_write_manifest");
+      out.finish({&header, &dconfig, &params});
+    }
+    return;
+  }
 
-#ifdef WRITE_PARALLEL
-  BENCHMARK(para_write_headers, state, {
+#if defined(WRITE_PARALLEL) || defined(ADAPTIVE_IO)
+  {
+    scoped_timer t("para_write_headers");
     header.write_to_file_parallel(outfile_hand);
     dconfig.write_to_file_parallel(outfile_hand);
     params.write_to_file_parallel(outfile_hand);
-  });
+  }
 
-  BENCHMARK(para_write_parts, state,
-            { parts.write_to_file_parallel(outfile_hand, state); });
+#ifdef ADAPTIVE_IO
+  {
+    scoped_timer t("adaptive_write_parts");
+    parts.write_to_file_adaptive(outfile_hand, state);
+  }
 #else
-
-  BENCHMARK(gather_header, state, {
+  {
+    scoped_timer t("para_write_parts");
+    parts.write_to_file_parallel(outfile_hand, state);
+  }
+#endif
+#else
+  {
+    scoped_timer t("gather_header");
     header.gather_data(state.island_comm);
     dconfig.gather_data(state.island_comm);
     params.gather_data(state.island_comm);
-  });
-
-  BENCHMARK(gather_parts, state, { parts.gather_data(state.island_comm); });
+  }
 
+  if (!opts.write_behind) {
+    scoped_timer t("gather_parts");
+    if (opts.shared_memory)
+      parts.gather_data_shared(state.island_comm, *topo);
+    else if (topo)
+      parts.gather_data_hierarchical(state.island_comm, *topo);
+    else
+      parts.gather_data(state.island_comm);
+  }
 
-  BENCHMARK(seri_write_headers, state, {
+  {
+    scoped_timer t("seri_write_headers");
     header.write_to_file_1proc(outfile_hand, state);
     dconfig.write_to_file_1proc(outfile_hand, state);
     params.write_to_file_1proc(outfile_hand, state);
-  });
+  }
+
+  if (opts.write_behind) {
+    // gather and write interleaved per dataset
+    scoped_timer t("behind_write_parts");
+    std::unique_ptr<write_behind> wb;
+    if (state.i_rank == 0)
+      wb = std::make_unique<write_behind>();
+    parts.write_to_file_behind(outfile_hand, state, wb.get(), topo);
+    if (wb)
+      wb->drain();
+  } else {
+    scoped_timer t("seri_write_parts");
+    parts.write_to_file_1proc(outfile_hand, state);
+  }
+#endif
+}
+
+int main(int argc, char **argv) try {
+  H5::Exception::dontPrint();
+  auto opts         = parser(argc, argv);
+  auto in_files_dir = opts.infiles_dir;
+  int numfiles      = opts.columnar_in ? count_columnar_snapshots(in_files_dir)
+                                       : count_hdf5_files(in_files_dir);
+  // --write-behind calls HDF5 on a helper thread while the main thread keeps calling MPI
+  mpi_environment env(&argc, &argv, opts.write_behind ? MPI_THREAD_FUNNELED : MPI_THREAD_SINGLE);
+  mpi_state state(numfiles);
+  if (opts.write_behind && !env.grants(MPI_THREAD_FUNNELED)) {
+    if (state.w_rank == 0)
+      fmt::print(stderr, "MPI does not provide MPI_THREAD_FUNNELED, --write-behind falls back to "
+                         "the synchronous writer\n");
+    opts.write_behind = false;
+  }
+
+  std::filesystem::path p(argv[0]);
+  const auto out_dirname = fmt::format("out_{}", p.filename().string());
+  auto out_file_dir = create_out_files_dir(in_files_dir, state, out_dirname);
 
-  BENCHMARK(seri_write_parts, state,
-            { parts.write_to_file_1proc(outfile_hand, state); });
+#ifdef ADAPTIVE_IO
+  auto &planner                 = global_io_planner();
+  planner.serial_max_bytes      = static_cast<std::uint64_t>(opts.serial_below_mib * (1 << 20));
+  planner.independent_min_bytes = static_cast<std::uint64_t>(opts.independent_above_mib * (1 << 20));
 #endif
+  global_lazy_cache().budget = static_cast<std::size_t>(opts.lazy_budget_mib * (1 << 20));
+
+  std::unique_ptr<node_topology> topo;
+  if (opts.hierarchical || opts.shared_memory)
+    topo = std::make_unique<node_topology>(state.island_comm);
+
+  // built once, every file of the island's queue is opened with it
+  const auto fapl = create_mpi_fapl(state.island_comm);
+
+  auto &timers        = global_timers();
+  timers.max_depth    = opts.timer_depth;
+  timers.track_memory = opts.memory;
+  // with fewer ranks than files, islands may run a different number of files per iteration,
+  // so phases are only aligned within the island
+  const bool aligned   = state.uniform_queues() && !opts.dynamic;
+  timers.phase_barrier = aligned ? state.world_comm.get() : state.island_comm.get();
+
+  std::unique_ptr<file_dispenser> dispenser;
+  if (opts.dynamic)
+    dispenser = std::make_unique<file_dispenser>(state);
+
+  auto drop_caches = [&] {
+    if (opts.drop_caches && state.i_rank == 0) {
+      // any island may pick up any file in dynamic mode
+      for (int f = 0; f < numfiles; ++f) {
+        if (!opts.dynamic && f % state.num_islands != state.i_color)
+          continue;
+        if (opts.columnar_in)
+          drop_columns_cache(snap_columns_path(in_files_dir, f));
+        else
+          drop_page_cache(snap_file_path(in_files_dir, f));
+        if (opts.columnar_out)
+          drop_columns_cache(snap_columns_path(out_file_dir, f));
+        else
+          drop_page_cache(snap_file_path(out_file_dir, f));
+      }
+    }
+    state.world_comm.ibarrier();
+  };
+
+  // one iteration processes all files of the island, phase times add up over its files
+  int files_done = 0;
+  auto run_queue = [&] {
+    files_done = 0;
+    auto run   = [&](int f) {
+      state.i_file = f;
+      run_once(state, in_files_dir, out_file_dir, opts, topo.get(), fapl);
+      ++files_done;
+    };
+    if (dispenser) {
+      dispenser->reset(state);
+      for (int f = state.i_color; f >= 0; f = dispenser->next(state))
+        run(f);
+    } else {
+      for (int f : state.files)
+        run(f);
+    }
+  };
+
+  for (int it = 0; it < opts.warmup; ++it) {
+    drop_caches();
+    run_queue();
+  }
+  timers.clear();
+  global_io_stats().clear();
+  global_mpio_report().clear();
+  global_pipeline_stats().clear();
+  global_lazy_cache().clear();
+
+  // keep every measured iteration, they are only reduced once at the end
+  std::vector<timer_registry> iterations;
+  for (int it = 0; it < opts.repeat; ++it) {
+    drop_caches();
+    run_queue();
+    iterations.push_back(timers);
+    timers.clear();
+  }
 
   auto size_island = state.island_comm.size();
   int min_island_size{0};
   state.world_comm.iallreduce(&size_island, &min_island_size, 1,
                               mpicpp::op::min());
 
-  if (state.w_rank == 0) {
-    fmt::print(
-      "{:3d},"
-      "{:5.3f},{:5.3f},{:5.3f},{:5.3f},{:5.3f},{:5.3f},{:5.3f},{:5.3f},{:5.3f},"
-      "{:5.3f},{:5.3f},{:5.3f},{:5.3f},{:5.3f},{:5.3f},{:5.3f},{:5.3f},{:5.3f},"
-      "{:5.3f},{:5.3f},{:5.3f},{:5.3f},{:5.3f},{:5.3f},"
-      "{:5.3f},{:5.3f},{:5.3f},{:5.3f},{:5.3f},{:5.3f},{:5.3f},{:5.3f},{:5.3f},"
-      "{:5.3f},{:5.3f},{:5.3f},{:5.3f},{:5.3f},{:5.3f},{:5.3f},{:5.3f},{:5.3f},"
-      "{:5.3f},{:5.3f},{:5.3f},{:5.3f},{:5.3f},{:5.3f}\n",
-      min_island_size, MIN_para_read_fopen, MAX_para_read_fopen,
-      AVG_para_read_fopen, MIN_seri_read_fopen, MAX_seri_read_fopen,
-      AVG_seri_read_fopen, MIN_para_write_fopen, MAX_para_write_fopen,
-      AVG_para_write_fopen, MIN_seri_write_fopen, MAX_seri_write_fopen,
-      AVG_seri_write_fopen, MIN_para_read_headers, MAX_para_read_headers,
-      AVG_para_read_headers, MIN_seri_read_headers, MAX_seri_read_headers,
-      AVG_seri_read_headers, MIN_distribute_header, MAX_distribute_header,
-      AVG_distribute_header, MIN_para_read_parts, MAX_para_read_parts,
-      AVG_para_read_parts, MIN_seri_read_parts, MAX_seri_read_parts,
-      AVG_seri_read_parts, MIN_distribute_parts, MAX_distribute_parts,
-      AVG_distribute_parts, MIN_para_write_headers, MAX_para_write_headers,
-      AVG_para_write_headers, MIN_seri_write_headers, MAX_seri_write_headers,
-      AVG_seri_write_headers, MIN_gather_header, MAX_gather_header,
-      AVG_gather_header, MIN_para_write_parts, MAX_para_write_parts,
-      AVG_para_write_parts, MIN_seri_write_parts, MAX_seri_write_parts,
-      AVG_seri_write_parts, MIN_gather_parts, MAX_gather_parts,
-      AVG_gather_parts);
+  // summed over ranks and iterations, nonzero means HDF5 silently did independent I/O
+  auto fallbacks = count_collective_fallbacks(global_mpio_report(), state.world_comm);
+
+  report_meta meta{{"nranks", std::to_string(state.w_size)},
+                   {"numfiles", std::to_string(numfiles)},
+                   {"num_islands", std::to_string(state.num_islands)},
+                   {"min_island_size", std::to_string(min_island_size)},
+                   {"collective_fallbacks", std::to_string(fallbacks)},
+                   {"island_nodes", topo ? std::to_string(topo->num_nodes) : "flat"},
+                   {"file_dispatch", opts.dynamic ? "dynamic" : "static"},
+                   {"coordinates", opts.fixed_point_coords ? "fixed_point" : "native"},
+                   {"ids", opts.id_codec ? "id_codec" : "native"},
+                   {"units", opts.physical_cgs ? "physical_cgs" : "code"},
+                   {"derived", opts.derived.empty() ? "none" : opts.derived}};
+  // the field list is comma separated, keep the csv report parseable
+  std::replace(meta.back().second.begin(), meta.back().second.end(), ',', '+');
+  {
+    // files of the busiest and idlest island in the last iteration
+    int done[2] = {files_done, -files_done};
+    int most[2];
+    MPI_Allreduce(done, most, 2, MPI_INT, MPI_MAX, state.world_comm.get());
+    meta.emplace_back("island_files_max", std::to_string(most[0]));
+    meta.emplace_back("island_files_min", std::to_string(-most[1]));
+  }
+  if (opts.pipeline > 0) {
+    // per iteration, slowest rank: disk reads, the part of them overlapped with scatters, and
+    // time blocked on scatters
+    auto const &ps = global_pipeline_stats();
+    double mine[3] = {ps.read_s / opts.repeat, ps.overlap_s / opts.repeat, ps.wait_s / opts.repeat};
+    double worst[3];
+    MPI_Allreduce(mine, worst, 3, MPI_DOUBLE, MPI_MAX, state.world_comm.get());
+    meta.emplace_back("pipeline_read_s", fmt::format("{:.6f}", worst[0]));
+    meta.emplace_back("pipeline_overlap_s", fmt::format("{:.6f}", worst[1]));
+    meta.emplace_back("pipeline_wait_s", fmt::format("{:.6f}", worst[2]));
+  }
+  if (opts.lazy) {
+    // per iteration, busiest rank; peak is the largest set of unmodified rows held at once
+    auto const &lc = global_lazy_cache();
+    unsigned long long mine[3] = {lc.loads / opts.repeat, lc.evictions / opts.repeat, lc.peak};
+    unsigned long long most[3];
+    MPI_Allreduce(mine, most, 3, MPI_UNSIGNED_LONG_LONG, MPI_MAX, state.world_comm.get());
+    meta.emplace_back("lazy_loads", std::to_string(most[0]));
+    meta.emplace_back("lazy_evictions", std::to_string(most[1]));
+    meta.emplace_back("lazy_peak_mib", fmt::format("{:.3f}", most[2] / double(1 << 20)));
+  }
+  if (opts.memory) {
+    auto columns = memory_meta(iterations, state.world_comm);
+    meta.insert(meta.end(), columns.begin(), columns.end());
+  }
+  if (opts.repeat == 1) {
+    auto reduced = iterations.front().reduce(state.world_comm);
+    if (state.w_rank == 0) {
+      if (opts.format == "json") {
+        print_timers_json(reduced, meta);
+      } else {
+        print_timers_csv(reduced, meta);
+      }
+    }
+  } else {
+    auto phases = summarize_iterations(iterations, state.world_comm);
+    if (state.w_rank == 0) {
+      meta.emplace_back("repeat", std::to_string(opts.repeat));
+      meta.emplace_back("warmup", std::to_string(opts.warmup));
+      if (opts.format == "json") {
+        print_stats_json(phases, meta);
+      } else {
+        print_stats_csv(phases, meta);
+      }
+    }
+  }
+
+  if (opts.io_report) {
+    print_dataset_bandwidth(global_io_stats(), state.world_comm);
+    print_rank_imbalance(global_io_stats(), state);
+    print_mpio_report(global_mpio_report(), state.world_comm);
+#ifdef ADAPTIVE_IO
+    if (state.w_rank == 0)
+      planner.print();
+#endif
   }
 
   return 0;
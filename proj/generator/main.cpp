@@ -0,0 +1,411 @@
+#include "main.hpp"
+#include <fmt/format.h>
+#include <mpicpp.hpp>
+#include "content_hash.hpp"
+#include "general_utils.hpp"
+#include "hdf5_utils.hpp"
+#include "io_trace_pmpi.hpp"
+#include "mpi_helpers.hpp"
+#include "snap_io.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <random>
+#include <type_traits>
+
+// unit metadata of TNG fields: a, h, length, mass, velocity exponents and to_cgs
+struct field_units {
+  double a, h, length, mass, velocity, to_cgs;
+};
+
+constexpr double kpc_in_cm    = 3.085678e21;
+constexpr double mass_in_g    = 1.989e43;
+constexpr double vel_in_cm_s  = 1e5;
+constexpr double density_cgs  = mass_in_g / (kpc_in_cm * kpc_in_cm * kpc_in_cm);
+// critical density in 1e10 Msun/h per (kpc/h)^3
+constexpr double rho_crit = 27.7536627e-9;
+// rows are generated in blocks of this many rows of a file, each from a stream of its own
+constexpr std::uint64_t block_rows = 4096;
+
+field_units units_of(const std::string &name) {
+  if (name == "Coordinates" || name == "CenterOfMass" || name == "BirthPos" ||
+      name == "SubfindHsml" || name == "BH_Hsml")
+    return {1.0, -1.0, 1.0, 0.0, 0.0, kpc_in_cm};
+  if (name == "Velocities" || name == "BirthVel")
+    return {0.5, 0.0, 0.0, 0.0, 1.0, vel_in_cm_s};
+  if (name == "SubfindVelDisp" || name == "GFM_WindDMVelDisp")
+    return {0.0, 0.0, 0.0, 0.0, 1.0, vel_in_cm_s};
+  if (name == "Masses" || name == "GFM_InitialMass" || name == "BH_Mass" ||
+      name == "GFM_WindHostHaloMass")
+    return {0.0, -1.0, 0.0, 1.0, 0.0, mass_in_g};
+  if (name == "Density" || name == "SubfindDensity" || name == "SubfindDMDensity" ||
+      name == "BH_Density")
+    return {-3.0, 2.0, -3.0, 1.0, 0.0, density_cgs};
+  if (name == "InternalEnergy" || name == "BH_U")
+    return {0.0, 0.0, 0.0, 0.0, 2.0, vel_in_cm_s * vel_in_cm_s};
+  if (name == "Potential")
+    return {-1.0, 0.0, 0.0, 0.0, 2.0, vel_in_cm_s * vel_in_cm_s};
+  return {0.0, 0.0, 0.0, 0.0, 0.0, 0.0};  // dimensionless
+}
+
+int columns_of(const std::string &name) {
+  if (name == "Coordinates" || name == "Velocities" || name == "CenterOfMass" ||
+      name == "BirthPos" || name == "BirthVel" || name == "MagneticField")
+    return 3;
+  if (name == "GFM_Metals")
+    return 10;
+  if (name == "GFM_MetalsTagged")
+    return 6;
+  if (name == "GFM_StellarPhotometrics")
+    return 8;
+  if (name == "FluidQuantities")
+    return 13;
+  return 1;
+}
+
+// Per-file particle counts: equal shares perturbed by `imbalance`, identical on every rank.
+std::vector<std::uint64_t> split_counts(std::uint64_t total, int numfiles, double imbalance,
+                                        std::mt19937_64 &rng) {
+  std::uniform_real_distribution<double> u(-1.0, 1.0);
+  std::vector<double> weights(numfiles);
+  double wsum = 0.0;
+  for (auto &w : weights) {
+    w = 1.0 + imbalance * u(rng);
+    wsum += w;
+  }
+  std::vector<std::uint64_t> counts(numfiles);
+  std::uint64_t assigned = 0;
+  for (int i = 0; i < numfiles; ++i) {
+    counts[i] = static_cast<std::uint64_t>(std::floor(total * weights[i] / wsum));
+    assigned += counts[i];
+  }
+  counts[numfiles - 1] += total - assigned;
+  return counts;
+}
+
+// Everything a rank needs to fill its rows of one PartType.
+struct slab_context {
+  std::uint64_t seed;
+  int file_idx;
+  int ptype;
+  std::uint64_t file_first;   // first global particle index of this file
+  std::uint64_t local_first;  // first row of this rank inside the file
+  std::uint64_t file_rows;
+  std::uint64_t local_rows;
+  double box_size;
+  double mean_mass;
+  const std::vector<std::array<double, 4>> *halos;  // x, y, z, radius
+  // stream of the block being filled
+  std::mt19937_64 rng{};
+  // PartType0 rows of this file, the cells tracers can point at
+  std::uint64_t gas_first{0};
+  std::uint64_t gas_rows{0};
+};
+
+// Stream of one row block of a dataset, keyed on the seed, the file, the PartType, the dataset
+// and the block, so the rows do not depend on how many ranks share the file.
+std::mt19937_64 block_rng(const slab_context &ctx, const std::string &name, std::uint64_t block) {
+  const std::uint64_t key[] = {ctx.seed, static_cast<std::uint64_t>(ctx.file_idx),
+                               static_cast<std::uint64_t>(ctx.ptype), block};
+  return std::mt19937_64(splitmix64(fnv1a(name.data(), name.size(), fnv1a(key, sizeof(key)))));
+}
+
+// Clustered positions: most particles sit in halos with lognormal radii, the rest is uniform.
+void fill_positions(std::vector<double> &out, slab_context &ctx) {
+  std::uniform_real_distribution<double> uni(0.0, 1.0);
+  std::uniform_int_distribution<std::size_t> pick(0, ctx.halos->size() - 1);
+  std::normal_distribution<double> gauss(0.0, 1.0);
+  for (std::uint64_t i = 0; i < ctx.local_rows; ++i) {
+    if (uni(ctx.rng) < 0.25) {
+      for (int d = 0; d < 3; ++d)
+        out[3 * i + d] = uni(ctx.rng) * ctx.box_size;
+      continue;
+    }
+    auto const &h = (*ctx.halos)[pick(ctx.rng)];
+    for (int d = 0; d < 3; ++d) {
+      double x = std::fmod(h[d] + h[3] * gauss(ctx.rng), ctx.box_size);
+      out[3 * i + d] = x < 0.0 ? x + ctx.box_size : x;
+    }
+  }
+}
+
+template <typename VT>
+void fill_field(std::vector<VT> &out, int cols, const std::string &name, slab_context &ctx) {
+  auto &rng = ctx.rng;
+  std::uniform_real_distribution<double> uni(0.0, 1.0);
+  std::normal_distribution<double> gauss(0.0, 1.0);
+  auto lognormal = [&](double median, double sigma) { return median * std::exp(sigma * gauss(rng)); };
+
+  if constexpr (std::is_integral_v<VT>) {
+    if (name == "BH_Progs") {
+      std::geometric_distribution<int> progs(0.3);
+      for (auto &v : out)
+        v = static_cast<VT>(progs(rng));
+      return;
+    }
+    // IDs are dense and almost sorted within a file, with short local swaps as in TNG chunks
+    const std::uint64_t id_base = (static_cast<std::uint64_t>(ctx.ptype) << 40) + ctx.file_first + 1;
+    for (std::uint64_t i = 0; i < out.size(); ++i)
+      out[i] = static_cast<VT>(id_base + ctx.local_first + i);
+    if (name == "ParentID") {
+      // tracers point at the gas cells of the same file, 0 when it has none, sorted per block
+      for (auto &v : out)
+        v = ctx.gas_rows ? static_cast<VT>(ctx.gas_first +
+                                           static_cast<std::uint64_t>(uni(rng) * ctx.gas_rows) + 1)
+                         : VT{0};
+      std::sort(out.begin(), out.end());
+      return;
+    }
+    for (std::size_t i = 0; i + 1 < out.size(); i += 2) {
+      if (uni(rng) < 0.1)
+        std::swap(out[i], out[i + 1]);
+    }
+    return;
+  } else {
+    for (std::size_t r = 0; r < out.size() / cols; ++r) {
+      VT *row = out.data() + r * cols;
+      for (int c = 0; c < cols; ++c) {
+        double v;
+        if (name == "Velocities" || name == "BirthVel")
+          v = 250.0 * gauss(rng);
+        else if (name == "CenterOfMass" || name == "BirthPos")
+          v = uni(rng) * ctx.box_size;
+        else if (name == "Masses" || name == "GFM_InitialMass" || name == "BH_Mass")
+          v = lognormal(ctx.mean_mass, 0.3);
+        else if (name == "Density" || name == "SubfindDensity" || name == "SubfindDMDensity" ||
+                 name == "BH_Density")
+          v = lognormal(1e-6, 2.0);
+        else if (name == "InternalEnergy" || name == "InternalEnergyOld" || name == "BH_U")
+          v = lognormal(5e3, 1.5);
+        else if (name == "ElectronAbundance")
+          v = 1.16 * uni(rng);
+        else if (name == "NeutralHydrogenAbundance")
+          v = std::pow(uni(rng), 4.0);
+        else if (name == "GFM_Metallicity")
+          v = lognormal(0.01, 1.0);
+        else if (name == "GFM_Metals")
+          v = c == 0 ? 0.76 : (c == 1 ? 0.24 : lognormal(1e-4, 1.0));
+        else if (name == "GFM_StellarFormationTime")
+          v = uni(rng) < 0.02 ? -uni(rng) : 0.1 + 0.9 * uni(rng);
+        else if (name == "GFM_StellarPhotometrics")
+          v = -15.0 + 2.0 * gauss(rng);
+        else if (name == "Potential")
+          v = -lognormal(1e5, 0.5);
+        else if (name == "StarFormationRate" || name == "BH_Mdot" || name == "BH_MdotBondi" ||
+                 name == "BH_MdotEddington")
+          v = uni(rng) < 0.9 ? 0.0 : lognormal(1e-3, 1.5);
+        else if (name == "SubfindHsml" || name == "BH_Hsml" || name == "StellarHsml")
+          v = lognormal(50.0, 1.0);
+        else if (name == "SubfindVelDisp" || name == "GFM_WindDMVelDisp")
+          v = lognormal(80.0, 0.5);
+        else if (name == "MagneticField")
+          v = 1e-3 * gauss(rng);
+        else
+          v = lognormal(1.0, 1.0);
+        row[c] = static_cast<VT>(v);
+      }
+    }
+  }
+}
+
+template <typename PT>
+void generate_parttype(PT &pt, const slab_context &ctx) {
+  pt.for_each_dataset([&](auto &ds) {
+    using VT  = typename std::decay_t<decltype(ds.data_chunk)>::value_type;
+    const int cols = columns_of(ds.name);
+    ds.total_dataspace_dims = {ctx.file_rows};
+    ds.local_dataspace_dims = {ctx.local_rows};
+    if (cols > 1) {
+      ds.total_dataspace_dims.push_back(cols);
+      ds.local_dataspace_dims.push_back(cols);
+    }
+    ds.local_dataspace_max_dims = ds.local_dataspace_dims;
+    ds.data_chunk.resize(ctx.local_rows * cols);
+    // the blocks overlapping this rank's rows are generated whole, the overlap is kept
+    const std::uint64_t local_end = ctx.local_first + ctx.local_rows;
+    std::vector<VT> rows;
+    for (std::uint64_t block = ctx.local_first / block_rows;
+         ctx.local_rows > 0 && block * block_rows < local_end; ++block) {
+      slab_context bctx = ctx;
+      bctx.local_first  = block * block_rows;
+      bctx.local_rows   = std::min(block_rows, ctx.file_rows - bctx.local_first);
+      bctx.rng          = block_rng(ctx, ds.name, block);
+      rows.resize(bctx.local_rows * cols);
+      if constexpr (std::is_same_v<VT, double>) {
+        if (ds.name == "Coordinates")
+          fill_positions(rows, bctx);
+        else
+          fill_field(rows, cols, ds.name, bctx);
+      } else {
+        fill_field(rows, cols, ds.name, bctx);
+      }
+      const std::uint64_t first = std::max(bctx.local_first, ctx.local_first);
+      const std::uint64_t last  = std::min(bctx.local_first + bctx.local_rows, local_end);
+      std::copy(rows.begin() + (first - bctx.local_first) * cols,
+                rows.begin() + (last - bctx.local_first) * cols,
+                ds.data_chunk.begin() + (first - ctx.local_first) * cols);
+    }
+    if constexpr (std::is_base_of_v<dataset_attributes, std::decay_t<decltype(ds)>>) {
+      auto u              = units_of(ds.name);
+      ds.a_scaling        = u.a;
+      ds.h_scaling        = u.h;
+      ds.length_scaling   = u.length;
+      ds.mass_scaling     = u.mass;
+      ds.velocity_scaling = u.velocity;
+      ds.to_cgs           = u.to_cgs;
+    }
+  });
+}
+
+void fill_header(header_base &hb, const gen_options &opts,
+                 const std::array<std::vector<std::uint64_t>, 6> &counts, int file_idx) {
+  hb.BoxSize                   = opts.box_size;
+  hb.Composition_vector_length = opts.dark() ? 0 : 10;
+  hb.Flag_Cooling              = opts.dark() ? 0 : 1;
+  hb.Flag_DoublePrecision      = 0;
+  hb.Flag_Feedback             = opts.dark() ? 0 : 1;
+  hb.Flag_Metals               = opts.dark() ? 0 : 10;
+  hb.Flag_Sfr                  = opts.dark() ? 0 : 1;
+  hb.Flag_StellarAge           = opts.dark() ? 0 : 1;
+  hb.NumFilesPerSnapshot       = opts.numfiles;
+  hb.HubbleParam               = 0.6774;
+  hb.Omega0                    = 0.3089;
+  hb.OmegaBaryon               = opts.dark() ? 0.0 : 0.0486;
+  hb.OmegaLambda               = 0.6911;
+  hb.Redshift                  = 0.0;
+  hb.Time                      = 1.0;
+  hb.UnitLength_in_cm          = kpc_in_cm;
+  hb.UnitMass_in_g             = mass_in_g;
+  hb.UnitVelocity_in_cm_per_s  = vel_in_cm_s;
+  hb.Git_commit                = "synthetic";
+  hb.Git_date                  = "synthetic";
+  for (int t = 0; t < 6; ++t) {
+    hb.NumPart_ThisFile[t]       = static_cast<std::int32_t>(counts[t][file_idx]);
+    hb.NumPart_Total[t]          = static_cast<std::uint32_t>(opts.npart[t] & 0xffffffffu);
+    hb.NumPart_Total_HighWord[t] = static_cast<std::uint32_t>(opts.npart[t] >> 32);
+  }
+  const double volume       = opts.box_size * opts.box_size * opts.box_size;
+  hb.MassTable              = {};
+  hb.MassTable[1] = (hb.Omega0 - hb.OmegaBaryon) * rho_crit * volume / opts.npart[1];
+}
+
+void fill_groups(const header_base &hb, bool dark, config_group &cfg, param_group &params) {
+  cfg.dcb = std::make_unique<darkconfigfields_base>();
+  cfg.dcb->PERIODIC = "";
+  cfg.dcb->NTYPES   = 6;
+  params.dpfb       = std::make_unique<darkparamfields_base>();
+  auto &p           = *params.dpfb;
+  p.BoxSize                  = hb.BoxSize;
+  p.HubbleParam              = hb.HubbleParam;
+  p.Omega0                   = hb.Omega0;
+  p.OmegaBaryon              = hb.OmegaBaryon;
+  p.OmegaLambda              = hb.OmegaLambda;
+  p.NumFilesPerSnapshot      = hb.NumFilesPerSnapshot;
+  p.ComovingIntegrationOn    = 1;
+  p.PeriodicBoundariesOn     = 1;
+  p.TimeMax                  = 1.0;
+  p.UnitLength_in_cm         = hb.UnitLength_in_cm;
+  p.UnitMass_in_g            = hb.UnitMass_in_g;
+  p.UnitVelocity_in_cm_per_s = hb.UnitVelocity_in_cm_per_s;
+  p.SnapshotFileBase         = "snap";
+
+  if (dark) {
+    params.dpfo                    = std::make_unique<darkparamfields_optional>();
+    params.dpfo->CellShapingFactor = 1.0;
+    return;
+  }
+  cfg.ndc    = std::make_unique<nondarkconfigdata>();
+  cfg.ndcl   = std::make_unique<nondarkconfigdata_large>();
+  params.ndpd = std::make_unique<nondarkparamfields>();
+  params.dpfe1 = std::make_unique<darkparamfields_ext1>();
+  params.dpfe2 = std::make_unique<darkparamfields_ext2>();
+}
+
+int main(int argc, char **argv) try {
+  H5::Exception::dontPrint();
+  auto opts = parser(argc, argv);
+  mpicpp::environment env(&argc, &argv);
+  mpi_state state(opts.numfiles);
+
+  // everything derived from the seed alone is identical on all ranks
+  std::mt19937_64 global_rng(opts.seed);
+  std::array<std::vector<std::uint64_t>, 6> counts;
+  for (int t = 0; t < 6; ++t) {
+    counts[t] = split_counts(opts.npart[t], opts.numfiles, opts.imbalance, global_rng);
+  }
+  std::vector<std::array<double, 4>> halos(256);
+  std::uniform_real_distribution<double> uni(0.0, 1.0);
+  for (auto &h : halos) {
+    h = {uni(global_rng) * opts.box_size, uni(global_rng) * opts.box_size,
+         uni(global_rng) * opts.box_size, opts.box_size * 2e-3 * std::exp(uni(global_rng) * 2.0)};
+  }
+
+  // with fewer ranks than files, each island generates its queue of files one after another
+  const auto fapl = create_mpi_fapl(state.island_comm);
+  for (std::size_t q = 0; q < state.files.size(); ++q) {
+    state.i_file = state.files[q];
+    header_group header;
+    config_group dconfig;
+    param_group params;
+    fill_header(header.hb, opts, counts, state.i_file);
+    fill_groups(header.hb, opts.dark(), dconfig, params);
+
+    part_groups parts(header);
+    const double volume = opts.box_size * opts.box_size * opts.box_size;
+    // first global index of `ptype` in this file
+    auto first_of = [&](int ptype) {
+      std::uint64_t first = 0;
+      for (int f = 0; f < state.i_file; ++f)
+        first += counts[ptype][f];
+      return first;
+    };
+    auto make_ctx = [&](int ptype) {
+      const std::uint64_t rows       = counts[ptype][state.i_file];
+      const std::uint64_t file_first = first_of(ptype);
+      const std::uint64_t base = rows / state.i_size, rem = rows % state.i_size;
+      const std::uint64_t i_rank = state.i_rank;
+      slab_context ctx{opts.seed,
+                       state.i_file,
+                       ptype,
+                       file_first,
+                       i_rank * base + std::min(i_rank, rem),
+                       rows,
+                       base + (i_rank < rem ? 1 : 0),
+                       opts.box_size,
+                       0.0,
+                       &halos};
+      const double baryon_mass = header.hb.OmegaBaryon * rho_crit * volume /
+                                 std::max<std::uint64_t>(opts.npart[0] + opts.npart[4], 1);
+      ctx.mean_mass = ptype == 5 ? 1e3 * baryon_mass : baryon_mass;
+      ctx.gas_first = first_of(0);
+      ctx.gas_rows  = counts[0][state.i_file];
+      return ctx;
+    };
+    if (parts.pt0)
+      generate_parttype(*parts.pt0, make_ctx(0));
+    if (parts.pt1)
+      generate_parttype(*parts.pt1, make_ctx(1));
+    if (parts.pt3)
+      generate_parttype(*parts.pt3, make_ctx(3));
+    if (parts.pt4)
+      generate_parttype(*parts.pt4, make_ctx(4));
+    if (parts.pt5)
+      generate_parttype(*parts.pt5, make_ctx(5));
+
+    auto outfile_hand = create_parallel_file_handle(opts.outfiles_dir, state, H5F_ACC_TRUNC, fapl);
+    header.write_to_file_parallel(outfile_hand);
+    dconfig.write_to_file_parallel(outfile_hand);
+    params.write_to_file_parallel(outfile_hand);
+    parts.write_to_file_parallel(outfile_hand, state);
+  }
+
+  if (state.w_rank == 0) {
+    fmt::print("wrote {} files to {} with NumPart_Total {}\n", opts.numfiles,
+               opts.outfiles_dir.string(), opts.npart);
+  }
+  return 0;
+} catch (...) {
+
+  return exception_handler();
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <argparse/argparse.hpp>
+#include <fmt/format.h>
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <filesystem>
+
+struct gen_options
+{
+    std::filesystem::path outfiles_dir;
+    int numfiles{4};
+    // total particles per PartType over all files, PartType2 is unused in TNG
+    std::array<std::uint64_t, 6> npart{};
+    double imbalance{0.0};
+    double box_size{75000.0};
+    std::uint64_t seed{42};
+
+    bool dark() const { return npart[0] == 0 && npart[3] == 0 && npart[4] == 0 && npart[5] == 0; }
+};
+
+inline gen_options parser(int argc, char **argv)
+{
+    argparse::ArgumentParser program("Synthetic TNG-like snapshot generator");
+    program.add_argument("outfiles_dir")
+        .help("Directory the snap_099.N.hdf5 files are written to")
+        .required();
+    program.add_argument("--files").help("Number of files per snapshot").default_value(4).scan<'i', int>();
+    program.add_argument("--gas").help("Total PartType0 particles").default_value(200000L).scan<'i', long>();
+    program.add_argument("--dm").help("Total PartType1 particles").default_value(200000L).scan<'i', long>();
+    program.add_argument("--tracers").help("Total PartType3 particles").default_value(200000L).scan<'i', long>();
+    program.add_argument("--stars").help("Total PartType4 particles").default_value(20000L).scan<'i', long>();
+    program.add_argument("--bh").help("Total PartType5 particles").default_value(200L).scan<'i', long>();
+    program.add_argument("--imbalance")
+        .help("Spread of per-file particle counts, 0 gives equal files, 1 gives 0x..2x the mean")
+        .default_value(0.0)
+        .scan<'g', double>();
+    program.add_argument("--box").help("BoxSize in kpc/h").default_value(75000.0).scan<'g', double>();
+    program.add_argument("--seed").help("Random seed").default_value(42L).scan<'i', long>();
+    program.parse_args(argc, argv);
+
+    gen_options opts;
+    opts.outfiles_dir = std::filesystem::path(program.get<std::string>("outfiles_dir"));
+    opts.numfiles = program.get<int>("--files");
+    std::array<long, 5> counts{program.get<long>("--gas"), program.get<long>("--dm"),
+                               program.get<long>("--tracers"), program.get<long>("--stars"),
+                               program.get<long>("--bh")};
+    if (std::any_of(counts.begin(), counts.end(), [](long n) { return n < 0; }))
+    {
+        throw std::runtime_error("--gas, --dm, --tracers, --stars and --bh must be >= 0\n");
+    }
+    opts.npart = {static_cast<std::uint64_t>(counts[0]),
+                  static_cast<std::uint64_t>(counts[1]),
+                  0,
+                  static_cast<std::uint64_t>(counts[2]),
+                  static_cast<std::uint64_t>(counts[3]),
+                  static_cast<std::uint64_t>(counts[4])};
+    opts.imbalance = program.get<double>("--imbalance");
+    opts.box_size = program.get<double>("--box");
+    opts.seed = static_cast<std::uint64_t>(program.get<long>("--seed"));
+    if (opts.numfiles < 1 || opts.imbalance < 0.0 || opts.imbalance > 1.0 || opts.box_size <= 0.0)
+    {
+        throw std::runtime_error("--files must be >= 1, --imbalance in [0, 1] and --box > 0\n");
+    }
+    if (opts.npart[1] == 0)
+    {
+        throw std::runtime_error("--dm must be > 0, MassTable and the dark layout depend on it\n");
+    }
+    std::filesystem::create_directories(opts.outfiles_dir);
+    return opts;
+}
@@ -1,110 +1,284 @@
 #include "main.hpp"
 #include <fmt/format.h>
 #include <mpicpp.hpp>
+#include "columnar_snapshot.hpp"
+#include "file_dispenser.hpp"
+#include "file_staging.hpp"
 #include "general_utils.hpp"
 #include "hdf5_utils.hpp"
+#include "io_trace_pmpi.hpp"
+#include "lazy_cache.hpp"
 #include "mpi_helpers.hpp"
+#include "node_topology.hpp"
+#include "scatter_pipeline.hpp"
 #include "snap_io.hpp"
+#include "write_behind.hpp"
 
-int main(int argc, char **argv) try {
-  H5::Exception::dontPrint();
-  auto in_files_dir = parser(argc, argv);
-  int numfiles      = count_hdf5_files(in_files_dir);
-  mpicpp::environment env(&argc, &argv);
-  mpi_state state(numfiles);
-
-  std::filesystem::path p(argv[0]);
-  const auto out_dirname = fmt::format("out_{}", p.filename().string());
-  auto out_file_dir      = create_out_files_dir(in_files_dir, state, out_dirname);
+#include <memory>
+#include <optional>
 
+// copies the island's current file (state.i_file), `topo` selects the node-aware
+// scatter/gather of the serial modes, flat when null
+void process_file(const mpi_state &state, const prog_options &opts,
+                  const std::filesystem::path &in_files_dir,
+                  const std::filesystem::path &out_file_dir, const node_topology *topo,
+                  const H5::FileAccPropList &fapl) {
   // --------------------
   // Input file handle
   // --------------------
-#ifdef READ_PARALLEL
-  auto in_file = create_parallel_file_handle(in_files_dir, state, H5F_ACC_RDONLY);
+  // --columnar-in reads a directory of raw columns, there is no HDF5 input to open
+  H5::H5File in_file;
+  if (!opts.columnar_in) {
+#if defined(READ_PARALLEL) || defined(ADAPTIVE_IO)
+    in_file = create_parallel_file_handle(in_files_dir, state, H5F_ACC_RDONLY, fapl);
 #else
-  auto in_file = create_serial_file_handle(in_files_dir, state, H5F_ACC_RDONLY);
+    in_file = create_serial_file_handle(in_files_dir, state, H5F_ACC_RDONLY);
 #endif
+  }
 
   // --------------------
   // Output file handle
   // --------------------
-#ifdef WRITE_PARALLEL
-  auto outfile_hand = create_parallel_file_handle(out_file_dir, state, H5F_ACC_TRUNC);
+  // --resume reopens an existing output, only missing or changed particle datasets are rewritten
+  int resuming = 0;
+  if (opts.resume && state.i_rank == 0)
+    resuming = std::filesystem::exists(snap_file_path(out_file_dir, state.i_file));
+  MPI_Bcast(&resuming, 1, MPI_INT, 0, state.island_comm.get());
+  const unsigned int out_flags = resuming ? H5F_ACC_RDWR : H5F_ACC_TRUNC;
+#if defined(WRITE_PARALLEL) || defined(ADAPTIVE_IO)
+  const bool out_parallel = true;
+#else
+  const bool out_parallel = false;
+#endif
+  // --columnar-out writes a directory of raw columns instead
+  H5::H5File outfile_hand;
+  if (!opts.columnar_out) {
+#if defined(WRITE_PARALLEL) || defined(ADAPTIVE_IO)
+    outfile_hand = create_parallel_file_handle(out_file_dir, state, out_flags, fapl);
 #else
-  auto outfile_hand = create_serial_file_handle(out_file_dir, state, H5F_ACC_TRUNC);
+    outfile_hand = create_serial_file_handle(out_file_dir, state, out_flags);
 #endif
+  }
+  // the attribute groups are small, they are always written again
+  if (resuming && (out_parallel || state.i_rank == 0)) {
+    for (const char *name : {"/Header", "/Config", "/Parameters"})
+      unlink_if_exists(outfile_hand, name);
+  }
 
-  // --------------------
-  // HEADER
-  // --------------------
-  header_group header;
+  // --stage-headers: the attribute groups are read from an in-memory image broadcast by rank 0,
+  // --columnar-in: from the image in the manifest
+  std::optional<H5::H5File> staged;
+  std::optional<column_manifest> columns_in;
+  if (opts.columnar_in) {
+    columns_in.emplace(read_manifest(snap_columns_path(in_files_dir, state.i_file),
+                                     state.island_comm));
+    staged = columns_in->open_groups();
+  } else if (opts.stage_headers) {
+    staged = stage_groups(in_file, {"/Header", "/Config", "/Parameters"}, state.island_comm);
+  }
+  auto read_group = [&](groups_base &group) {
+    if (staged) {
+      group.read_from_file_parallel(*staged);
+      return;
+    }
 #ifdef READ_PARALLEL
-  header.read_from_file_parallel(in_file);
+    group.read_from_file_parallel(in_file);
 #else
-  header.read_from_file_1proc(in_file, state);
-  header.distribute_data(state.island_comm);
+    group.read_from_file_1proc(in_file, state);
+    group.distribute_data(state.island_comm);
 #endif
-
-#ifdef WRITE_PARALLEL
-  header.write_to_file_parallel(outfile_hand);
+  };
+  // with --columnar-out the attribute groups go into the manifest, after the particles
+  auto write_group = [&](groups_base &group) {
+    if (opts.columnar_out)
+      return;
+#if defined(WRITE_PARALLEL) || defined(ADAPTIVE_IO)
+    group.write_to_file_parallel(outfile_hand);
 #else
-  header.gather_data(state.island_comm);
-  header.write_to_file_1proc(outfile_hand, state);
+    group.gather_data(state.island_comm);
+    group.write_to_file_1proc(outfile_hand, state);
 #endif
+  };
+
+  // --------------------
+  // HEADER
+  // --------------------
+  header_group header;
+  read_group(header);
+  write_group(header);
 
   // --------------------
   // CONFIG
   // --------------------
   config_group dconfig;
-#ifdef READ_PARALLEL
-  dconfig.read_from_file_parallel(in_file);
-#else
-  dconfig.read_from_file_1proc(in_file, state);
-  dconfig.distribute_data(state.island_comm);
-#endif
-
-#ifdef WRITE_PARALLEL
-  dconfig.write_to_file_parallel(outfile_hand);
-#else
-  dconfig.gather_data(state.island_comm);
-  dconfig.write_to_file_1proc(outfile_hand, state);
-#endif
+  read_group(dconfig);
+  write_group(dconfig);
 
   // --------------------
   // PARAMS
   // --------------------
   param_group params;
-#ifdef READ_PARALLEL
-  params.read_from_file_parallel(in_file);
-#else
-  params.read_from_file_1proc(in_file, state);
-  params.distribute_data(state.island_comm);
-#endif
-
-#ifdef WRITE_PARALLEL
-  params.write_to_file_parallel(outfile_hand);
-#else
-  params.gather_data(state.island_comm);
-  params.write_to_file_1proc(outfile_hand, state);
-#endif
+  read_group(params);
+  write_group(params);
 
   // --------------------
   // PARTICLES
   // --------------------
   part_groups parts;
-#ifdef READ_PARALLEL
-  parts.read_from_file_parallel(in_file, state, header);
+  if (opts.fixed_point_coords)
+    parts.fixed_point_box = header.hb.BoxSize;
+  parts.id_codec = opts.id_codec;
+  if (opts.physical_cgs) {
+    parts.physical_a = header.hb.Time;
+    parts.physical_h = header.hb.HubbleParam;
+  }
+  parts.derived_fields = parse_derived_fields(opts.derived);
+  parts.derived_only   = opts.derived_only;
+  if (opts.resume)
+    parts.plan_resume(in_file, outfile_hand, snap_file_path(in_files_dir, state.i_file), state,
+                      header, out_parallel);
+#if defined(READ_PARALLEL) || defined(ADAPTIVE_IO)
+  const bool read_parallel = true;
+#else
+  const bool read_parallel = false;
+#endif
+  if (opts.columnar_in) {
+    parts.map_from_columns(snap_columns_path(in_files_dir, state.i_file), *columns_in, state,
+                           header);
+  } else if (opts.lazy) {
+    // the rows are read where they are first used, the write or the gather
+    parts.open_lazy(in_file, state, header, read_parallel);
+  } else {
+#if defined(ADAPTIVE_IO)
+    parts.read_from_file_adaptive(in_file, state, header);
+#elif defined(READ_PARALLEL)
+    parts.read_from_file_parallel(in_file, state, header);
 #else
-  parts.read_from_file_1proc(in_file, state,header);
-  parts.distribute_data(state.island_comm);
+    if (opts.shared_memory) {
+      parts.read_from_file_shared(in_file, state, header, *topo);
+    } else if (opts.pipeline > 0) {
+      scatter_pipeline pipe(opts.pipeline);
+      parts.read_from_file_pipelined(in_file, state, header, pipe);
+      pipe.drain();
+    } else {
+      if (opts.mmap)
+        parts.read_from_file_mapped(in_file, state, header);
+      else
+        parts.read_from_file_1proc(in_file, state,header);
+      if (topo)
+        parts.distribute_data_hierarchical(state.island_comm, *topo);
+      else
+        parts.distribute_data(state.island_comm);
+    }
 #endif
+  }
 
-#ifdef WRITE_PARALLEL
+  // on the rows as they arrived, before anything reorders or gathers them
+  parts.compute_derived(header);
+
+  if (opts.resume)
+    parts.hash_rows(state.island_comm);
+
+  std::vector<ph_cell_offsets> offsets;
+  if (opts.ph_sort) {
+    offsets = parts.sort_by_peano_hilbert(state.island_comm, header.hb.BoxSize, opts.ph_level);
+  }
+
+  if (opts.columnar_out) {
+    // MPI-IO from the distributed rows in the parallel variants, POSIX after a gather otherwise
+    column_writer out(snap_columns_path(out_file_dir, state.i_file), state.island_comm);
+    parts.write_to_columns(out, state, out_parallel);
+    out.finish({&header, &dconfig, &params});
+    return;
+  }
+
+#if defined(ADAPTIVE_IO)
+  parts.write_to_file_adaptive(outfile_hand, state);
+  if (opts.ph_sort)
+    write_ph_offsets_parallel(outfile_hand, offsets, state.island_comm);
+#elif defined(WRITE_PARALLEL)
   parts.write_to_file_parallel(outfile_hand, state);
+  if (opts.ph_sort)
+    write_ph_offsets_parallel(outfile_hand, offsets, state.island_comm);
 #else
-  parts.gather_data(state.island_comm);
-  parts.write_to_file_1proc(outfile_hand, state);
+  if (opts.write_behind) {
+    std::unique_ptr<write_behind> wb;
+    if (state.i_rank == 0)
+      wb = std::make_unique<write_behind>();
+    parts.write_to_file_behind(outfile_hand, state, wb.get(), topo);
+    if (wb)
+      wb->drain();
+  } else {
+    if (opts.shared_memory)
+      parts.gather_data_shared(state.island_comm, *topo);
+    else if (topo)
+      parts.gather_data_hierarchical(state.island_comm, *topo);
+    else
+      parts.gather_data(state.island_comm);
+    parts.write_to_file_1proc(outfile_hand, state);
+  }
+  if (opts.ph_sort)
+    write_ph_offsets_1proc(outfile_hand, offsets, state);
+#endif
+
+  // written last, a dataset without them is rewritten by the next --resume
+  if (opts.resume)
+    parts.stamp_resume(outfile_hand, state, out_parallel);
+}
+
+int main(int argc, char **argv) try {
+  H5::Exception::dontPrint();
+  auto opts         = parser(argc, argv);
+  auto in_files_dir = opts.infiles_dir;
+  int numfiles      = opts.columnar_in ? count_columnar_snapshots(in_files_dir)
+                                       : count_hdf5_files(in_files_dir);
+  // --write-behind calls HDF5 on a helper thread while the main thread keeps calling MPI
+  mpi_environment env(&argc, &argv, opts.write_behind ? MPI_THREAD_FUNNELED : MPI_THREAD_SINGLE);
+  mpi_state state(numfiles);
+  if (opts.write_behind && !env.grants(MPI_THREAD_FUNNELED)) {
+    if (state.w_rank == 0)
+      fmt::print(stderr, "MPI does not provide MPI_THREAD_FUNNELED, --write-behind falls back to "
+                         "the synchronous writer\n");
+    opts.write_behind = false;
+  }
+
+  std::filesystem::path p(argv[0]);
+  const auto out_dirname = fmt::format("out_{}", p.filename().string());
+  auto out_file_dir      = create_out_files_dir(in_files_dir, state, out_dirname);
+
+#ifdef ADAPTIVE_IO
+  auto &planner                 = global_io_planner();
+  planner.serial_max_bytes      = static_cast<std::uint64_t>(opts.serial_below_mib * (1 << 20));
+  planner.independent_min_bytes = static_cast<std::uint64_t>(opts.independent_above_mib * (1 << 20));
+#endif
+  global_lazy_cache().budget = static_cast<std::size_t>(opts.lazy_budget_mib * (1 << 20));
+
+  // node-aware scatter/gather of the serial modes
+  std::unique_ptr<node_topology> topo;
+  if (opts.hierarchical || opts.shared_memory)
+    topo = std::make_unique<node_topology>(state.island_comm);
+
+  // built once, every file of the island's queue is opened with it
+  const auto fapl = create_mpi_fapl(state.island_comm);
+
+  if (opts.dynamic) {
+    // islands start with their own file, then pull whichever file is still unprocessed
+    file_dispenser dispenser(state);
+    for (int f = state.i_color; f >= 0; f = dispenser.next(state)) {
+      state.i_file = f;
+      process_file(state, opts, in_files_dir, out_file_dir, topo.get(), fapl);
+    }
+  } else {
+    // with fewer ranks than files, each island works through its queue of files
+    for (int f : state.files) {
+      state.i_file = f;
+      process_file(state, opts, in_files_dir, out_file_dir, topo.get(), fapl);
+    }
+  }
+
+#ifdef ADAPTIVE_IO
+  if (state.w_rank == 0)
+    planner.print();
 #endif
 
   return 0;
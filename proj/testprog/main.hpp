@@ -4,19 +4,192 @@
 #include <fmt/format.h>
 #include <filesystem>
 
-inline std::filesystem::path parser(int argc, char **argv)
+struct prog_options
+{
+    std::filesystem::path infiles_dir;
+    bool ph_sort{false};
+    int ph_level{4};
+    double serial_below_mib{1.0};
+    double independent_above_mib{64.0};
+    bool hierarchical{false};
+    bool shared_memory{false};
+    int pipeline{0};
+    bool mmap{false};
+    bool stage_headers{false};
+    bool lazy{false};
+    double lazy_budget_mib{0.0};
+    bool write_behind{false};
+    bool dynamic{false};
+    bool resume{false};
+    bool fixed_point_coords{false};
+    bool columnar_out{false};
+    bool columnar_in{false};
+    bool id_codec{false};
+    bool physical_cgs{false};
+    std::string derived{};
+    bool derived_only{false};
+};
+
+inline prog_options parser(int argc, char **argv)
 {
     argparse::ArgumentParser program("HDF5 MPI IO");
     program.add_argument("infiles_dir")
         .help("Directory containing input HDF5 files")
         .required();
+    program.add_argument("--ph-sort")
+        .help("Write particles sorted by Peano-Hilbert key together with an /Offsets table")
+        .flag();
+    program.add_argument("--ph-level")
+        .help("Refinement level of the /Offsets cells (8^level cells per PartType)")
+        .default_value(4)
+        .scan<'i', int>();
+    program.add_argument("--serial-below-mib")
+        .help("ADAPTIVE_IO: datasets smaller than this are read by island rank 0 and scattered")
+        .default_value(1.0)
+        .scan<'g', double>();
+    program.add_argument("--independent-above-mib")
+        .help("ADAPTIVE_IO: per-rank share from which independent instead of collective I/O is used")
+        .default_value(64.0)
+        .scan<'g', double>();
+    program.add_argument("--hierarchical")
+        .help("Serial modes: scatter/gather through one leader rank per node instead of flat")
+        .flag();
+    program.add_argument("--shared-memory")
+        .help("Serial read: rank 0 reads into node-shared memory, node ranks view their rows")
+        .flag();
+    program.add_argument("--pipeline")
+        .help("Serial read: keep up to N scatters in flight while rank 0 reads the next datasets, 0 off")
+        .default_value(0)
+        .scan<'i', int>();
+    program.add_argument("--mmap")
+        .help("Serial read: rank 0 maps uncompressed contiguous datasets from the file instead of reading them")
+        .flag();
+    program.add_argument("--stage-headers")
+        .help("Rank 0 broadcasts an in-memory image of the attribute groups, every rank reads it locally")
+        .flag();
+    program.add_argument("--lazy")
+        .help("Read each particle dataset on first use instead of up front")
+        .flag();
+    program.add_argument("--lazy-budget-mib")
+        .help("--lazy: evict unmodified datasets beyond this many MiB per rank, 0 keeps all")
+        .default_value(0.0)
+        .scan<'g', double>();
+    program.add_argument("--write-behind")
+        .help("Serial write: rank 0 writes each dataset on a helper thread while the next is gathered")
+        .flag();
+    program.add_argument("--dynamic")
+        .help("Islands that finish a file pull the next unprocessed one instead of a fixed queue")
+        .flag();
+    program.add_argument("--resume")
+        .help("Reopen existing outputs and only rewrite particle datasets that are missing or changed")
+        .flag();
+    program.add_argument("--fixed-point-coords")
+        .help("Write Coordinates as 32-bit fractions of BoxSize, read back to within BoxSize / 2^33")
+        .flag();
+    program.add_argument("--id-codec")
+        .help("Write ParticleIDs, ParentID and TracerID chunked through a delta + zigzag + bit-packing filter")
+        .flag();
+    program.add_argument("--columnar-out")
+        .help("Write each snapshot as a directory of raw column files plus a manifest instead of HDF5")
+        .flag();
+    program.add_argument("--columnar-in")
+        .help("Read snapshots written with --columnar-out, every rank maps its rows of each column")
+        .flag();
+    program.add_argument("--physical-cgs")
+        .help("Convert float and double datasets to physical CGS units as they are read, using Time and HubbleParam")
+        .flag();
+    program.add_argument("--derived")
+        .help("Comma separated derived fields to compute after the read and write as datasets: "
+              "Temperature, Metallicity_Solar, StellarAge")
+        .default_value(std::string(""));
+    program.add_argument("--derived-only")
+        .help("--derived: read and write only the inputs of the requested fields")
+        .flag();
     program.parse_args(argc, argv);
 
-    auto infiles_dir = std::filesystem::path(program.get<std::string>("infiles_dir"));
-    if (!std::filesystem::exists(infiles_dir) || !std::filesystem::is_directory(infiles_dir))
+    prog_options opts;
+    opts.infiles_dir = std::filesystem::path(program.get<std::string>("infiles_dir"));
+    opts.ph_sort = program.get<bool>("--ph-sort");
+    opts.ph_level = program.get<int>("--ph-level");
+    opts.serial_below_mib = program.get<double>("--serial-below-mib");
+    opts.independent_above_mib = program.get<double>("--independent-above-mib");
+    opts.hierarchical = program.get<bool>("--hierarchical");
+    opts.shared_memory = program.get<bool>("--shared-memory");
+    opts.pipeline = program.get<int>("--pipeline");
+    opts.mmap = program.get<bool>("--mmap");
+    opts.stage_headers = program.get<bool>("--stage-headers");
+    opts.lazy = program.get<bool>("--lazy");
+    opts.lazy_budget_mib = program.get<double>("--lazy-budget-mib");
+    opts.write_behind = program.get<bool>("--write-behind");
+    opts.dynamic = program.get<bool>("--dynamic");
+    opts.resume = program.get<bool>("--resume");
+    opts.fixed_point_coords = program.get<bool>("--fixed-point-coords");
+    opts.id_codec = program.get<bool>("--id-codec");
+    opts.columnar_out = program.get<bool>("--columnar-out");
+    opts.columnar_in = program.get<bool>("--columnar-in");
+    opts.physical_cgs = program.get<bool>("--physical-cgs");
+    opts.derived = program.get<std::string>("--derived");
+    opts.derived_only = program.get<bool>("--derived-only");
+    if (!std::filesystem::exists(opts.infiles_dir) || !std::filesystem::is_directory(opts.infiles_dir))
     {
-        auto str = fmt::format("Input directory: {} does not exist or is not a directory\n", infiles_dir.string());
+        auto str = fmt::format("Input directory: {} does not exist or is not a directory\n", opts.infiles_dir.string());
         throw std::runtime_error(str);
     }
-    return infiles_dir;
-}
\ No newline at end of file
+    if (opts.ph_level < 1 || opts.ph_level > 7)
+    {
+        throw std::runtime_error(fmt::format("--ph-level must be in [1, 7], got {}\n", opts.ph_level));
+    }
+    if (opts.serial_below_mib < 0.0 || opts.independent_above_mib < 0.0)
+    {
+        throw std::runtime_error("--serial-below-mib and --independent-above-mib must be >= 0\n");
+    }
+    if (opts.pipeline < 0 || (opts.pipeline > 0 && opts.shared_memory))
+    {
+        throw std::runtime_error("--pipeline must be >= 0 and cannot be combined with --shared-memory\n");
+    }
+    if (opts.mmap && (opts.shared_memory || opts.pipeline > 0))
+    {
+        throw std::runtime_error("--mmap cannot be combined with --shared-memory or --pipeline\n");
+    }
+    // a lazy dataset is read on first use, in the write-behind gather that would be an HDF5 call on the
+    // main thread while the helper writes
+    if (opts.lazy && (opts.shared_memory || opts.pipeline > 0 || opts.mmap || opts.write_behind))
+    {
+        throw std::runtime_error("--lazy cannot be combined with --shared-memory, --pipeline, --mmap or --write-behind\n");
+    }
+    if (opts.lazy_budget_mib < 0.0)
+    {
+        throw std::runtime_error("--lazy-budget-mib must be >= 0\n");
+    }
+    if (opts.resume && opts.ph_sort)
+    {
+        throw std::runtime_error("--resume cannot be combined with --ph-sort\n");
+    }
+    if (opts.columnar_out &&
+        (opts.resume || opts.ph_sort || opts.write_behind || opts.fixed_point_coords || opts.id_codec))
+    {
+        throw std::runtime_error("--columnar-out cannot be combined with --resume, --ph-sort, --write-behind, "
+                                 "--fixed-point-coords or --id-codec\n");
+    }
+    if (opts.columnar_in &&
+        (opts.resume || opts.lazy || opts.mmap || opts.shared_memory || opts.pipeline > 0 || opts.stage_headers))
+    {
+        throw std::runtime_error("--columnar-in cannot be combined with --resume, --lazy, --mmap, "
+                                 "--shared-memory, --pipeline or --stage-headers\n");
+    }
+    if (opts.physical_cgs &&
+        (opts.lazy || opts.pipeline > 0 || opts.resume || opts.ph_sort || opts.fixed_point_coords))
+    {
+        throw std::runtime_error("--physical-cgs cannot be combined with --lazy, --pipeline, --resume, "
+                                 "--ph-sort or --fixed-point-coords\n");
+    }
+    if (opts.derived_only && opts.derived.empty())
+    {
+        throw std::runtime_error("--derived-only needs --derived\n");
+    }
+    if (!opts.derived.empty() && (opts.resume || (opts.derived_only && opts.ph_sort)))
+    {
+        throw std::runtime_error("--derived cannot be combined with --resume, --derived-only not with --ph-sort\n");
+    }
+    return opts;
+}
@@ -0,0 +1,220 @@
+#include "main.hpp"
+#include <fmt/format.h>
+#include "general_utils.hpp"
+#include "io_trace.hpp"
+
+#include <algorithm>
+#include <array>
+#include <fstream>
+#include <map>
+#include <set>
+#include <tuple>
+
+const char *layer_name(trace_layer l) { return l == trace_layer::hdf5 ? "hdf5" : "mpiio"; }
+
+const char *op_name(trace_op op) {
+  constexpr const char *names[] = {"read", "write", "attr_read", "attr_write"};
+  return names[static_cast<int>(op)];
+}
+
+const char *mode_name(trace_mode m) {
+  constexpr const char *names[] = {"serial", "independent", "collective"};
+  return names[static_cast<int>(m)];
+}
+
+std::vector<trace_record> load_traces(const std::filesystem::path &dir) {
+  std::vector<trace_record> all;
+  for (auto const &entry : std::filesystem::directory_iterator(dir)) {
+    auto fname = entry.path().filename().string();
+    if (fname.rfind("io_trace.", 0) != 0 || entry.path().extension() != ".bin")
+      continue;
+    std::ifstream in(entry.path(), std::ios::binary);
+    char magic[sizeof(trace_magic)];
+    std::uint32_t rec_size = 0;
+    in.read(magic, sizeof(magic));
+    in.read(reinterpret_cast<char *>(&rec_size), sizeof(rec_size));
+    if (!in || !std::equal(magic, magic + sizeof(magic), trace_magic) ||
+        rec_size != sizeof(trace_record)) {
+      throw std::runtime_error(fmt::format("{} is not a trace of this version\n", fname));
+    }
+    trace_record rec;
+    while (in.read(reinterpret_cast<char *>(&rec), sizeof(rec))) {
+      all.push_back(rec);
+    }
+  }
+  std::sort(all.begin(), all.end(),
+            [](auto const &a, auto const &b) { return a.t_start < b.t_start; });
+  return all;
+}
+
+// request sizes in powers of 4 from 1 KiB up to 256 MiB
+constexpr int size_buckets = 11;
+
+int size_bucket(std::uint64_t size) {
+  int b = 0;
+  for (std::uint64_t limit = 1024; b < size_buckets - 1 && size >= limit; limit *= 4) {
+    ++b;
+  }
+  return b;
+}
+
+void print_summary(const std::vector<trace_record> &recs) {
+  struct agg {
+    std::size_t calls{0};
+    std::uint64_t bytes{0};
+    double seconds{0.0};
+    std::set<int> ranks{};
+  };
+  std::map<std::tuple<int, int, int>, agg> rows;
+  for (auto const &r : recs) {
+    auto &a = rows[{static_cast<int>(r.layer), static_cast<int>(r.op), static_cast<int>(r.mode)}];
+    ++a.calls;
+    a.bytes += r.size;
+    a.seconds += r.t_stop - r.t_start;
+    a.ranks.insert(r.rank);
+  }
+  fmt::print("{:<6s} {:<11s} {:<12s} {:>10s} {:>10s} {:>10s} {:>12s} {:>6s}\n", "layer", "op",
+             "mode", "calls", "GiB", "sum_s", "KiB/call", "ranks");
+  for (auto const &[key, a] : rows) {
+    auto [l, o, m] = key;
+    fmt::print("{:<6s} {:<11s} {:<12s} {:>10d} {:>10.4f} {:>10.4f} {:>12.1f} {:>6d}\n",
+               layer_name(static_cast<trace_layer>(l)), op_name(static_cast<trace_op>(o)),
+               mode_name(static_cast<trace_mode>(m)), a.calls,
+               a.bytes / (1024.0 * 1024.0 * 1024.0), a.seconds, a.bytes / 1024.0 / a.calls,
+               a.ranks.size());
+  }
+}
+
+void print_size_histogram(const std::vector<trace_record> &recs) {
+  std::map<std::pair<int, int>, std::array<std::size_t, size_buckets>> hist;
+  for (auto const &r : recs) {
+    auto &h = hist.try_emplace({static_cast<int>(r.layer), static_cast<int>(r.op)}).first->second;
+    ++h[size_bucket(r.size)];
+  }
+  fmt::print("\nrequest sizes (calls per bucket):\n{:<18s}", "");
+  constexpr const char *labels[size_buckets] = {"<1K",  "<4K",  "<16K", "<64K", "<256K", "<1M",
+                                                "<4M",  "<16M", "<64M", "<256M", ">=256M"};
+  for (auto label : labels) {
+    fmt::print(" {:>8s}", label);
+  }
+  fmt::print("\n");
+  for (auto const &[key, h] : hist) {
+    fmt::print("{:<18s}", fmt::format("{} {}", layer_name(static_cast<trace_layer>(key.first)),
+                                      op_name(static_cast<trace_op>(key.second))));
+    for (auto c : h) {
+      fmt::print(" {:>8d}", c);
+    }
+    fmt::print("\n");
+  }
+}
+
+// Consecutive requests of one rank on one file: does the next start where the last ended?
+void print_access_pattern(const std::vector<trace_record> &recs) {
+  struct pattern {
+    std::size_t sequential{0}, forward{0}, backward{0};
+  };
+  std::map<std::pair<int, int>, pattern> patterns;
+  std::map<std::tuple<int, int, int, std::string>, std::uint64_t> last_end;
+  for (auto const &r : recs) {
+    if (!(r.flags & trace_offset_absolute) || r.op == trace_op::attr_read ||
+        r.op == trace_op::attr_write)
+      continue;
+    auto key = std::make_tuple(r.rank, static_cast<int>(r.layer), static_cast<int>(r.op),
+                               std::string(r.file));
+    auto &p  = patterns[{static_cast<int>(r.layer), static_cast<int>(r.op)}];
+    auto it  = last_end.find(key);
+    if (it != last_end.end()) {
+      if (r.offset == it->second)
+        ++p.sequential;
+      else if (r.offset > it->second)
+        ++p.forward;
+      else
+        ++p.backward;
+    }
+    last_end[key] = r.offset + r.size;
+  }
+  fmt::print("\naccess pattern per rank and file (requests after the first):\n");
+  fmt::print("{:<18s} {:>12s} {:>12s} {:>12s}\n", "", "sequential", "fwd_gap", "backward");
+  for (auto const &[key, p] : patterns) {
+    const double n = std::max<std::size_t>(p.sequential + p.forward + p.backward, 1);
+    fmt::print("{:<18s} {:>11.1f}% {:>11.1f}% {:>11.1f}%\n",
+               fmt::format("{} {}", layer_name(static_cast<trace_layer>(key.first)),
+                           op_name(static_cast<trace_op>(key.second))),
+               100.0 * p.sequential / n, 100.0 * p.forward / n, 100.0 * p.backward / n);
+  }
+}
+
+// Coarse timeline: per time bin, how many ranks were inside a data call and how much moved.
+// Prefers the MPI-IO layer since that is what reaches the file system.
+void print_timeline(const std::vector<trace_record> &recs, int bins) {
+  const bool have_mpiio = std::any_of(recs.begin(), recs.end(), [](auto const &r) {
+    return r.layer == trace_layer::mpiio;
+  });
+  const auto layer = have_mpiio ? trace_layer::mpiio : trace_layer::hdf5;
+  double t0 = 1e300, t1 = -1e300;
+  for (auto const &r : recs) {
+    t0 = std::min(t0, r.t_start);
+    t1 = std::max(t1, r.t_stop);
+  }
+  const double width = std::max(t1 - t0, 1e-9) / bins;
+  std::vector<std::set<int>> readers(bins), writers(bins);
+  std::vector<double> bytes(bins, 0.0);
+  for (auto const &r : recs) {
+    if (r.layer != layer || (r.op != trace_op::read && r.op != trace_op::write))
+      continue;
+    const int b0 = std::min(static_cast<int>((r.t_start - t0) / width), bins - 1);
+    const int b1 = std::min(static_cast<int>((r.t_stop - t0) / width), bins - 1);
+    const double span = std::max(r.t_stop - r.t_start, 1e-12);
+    for (int b = b0; b <= b1; ++b) {
+      (r.op == trace_op::read ? readers : writers)[b].insert(r.rank);
+      const double lo = std::max(r.t_start, t0 + b * width);
+      const double hi = std::min(r.t_stop, t0 + (b + 1) * width);
+      bytes[b] += r.size * (b0 == b1 ? 1.0 : std::max(hi - lo, 0.0) / span);
+    }
+  }
+  fmt::print("\ntimeline of the {} layer ({:.4f} s per bin):\n", layer_name(layer), width);
+  fmt::print("{:>10s} {:>8s} {:>8s} {:>10s}\n", "t_s", "readers", "writers", "MiB");
+  for (int b = 0; b < bins; ++b) {
+    fmt::print("{:>10.4f} {:>8d} {:>8d} {:>10.2f}\n", b * width, readers[b].size(),
+               writers[b].size(), bytes[b] / (1024.0 * 1024.0));
+  }
+}
+
+void write_timeline_csv(const std::vector<trace_record> &recs, const std::filesystem::path &out) {
+  const double t0 = recs.empty() ? 0.0 : recs.front().t_start;
+  auto fp         = std::fopen(out.c_str(), "w");
+  if (!fp)
+    throw std::runtime_error(fmt::format("cannot write {}\n", out.string()));
+  fmt::print(fp, "rank,layer,op,mode,file,object,offset,absolute,size,t_start,t_stop\n");
+  for (auto const &r : recs) {
+    fmt::print(fp, "{},{},{},{},{},{},{},{},{},{:.6f},{:.6f}\n", r.rank, layer_name(r.layer),
+               op_name(r.op), mode_name(r.mode), r.file, r.object, r.offset,
+               (r.flags & trace_offset_absolute) ? 1 : 0, r.size, r.t_start - t0, r.t_stop - t0);
+  }
+  std::fclose(fp);
+}
+
+int main(int argc, char **argv) try {
+  auto opts = parser(argc, argv);
+  auto recs = load_traces(opts.trace_dir);
+  if (recs.empty()) {
+    fmt::print("no trace records in {}\n", opts.trace_dir.string());
+    return 0;
+  }
+  std::set<int> ranks;
+  for (auto const &r : recs) {
+    ranks.insert(r.rank);
+  }
+  fmt::print("{} records from {} ranks\n\n", recs.size(), ranks.size());
+  print_summary(recs);
+  print_size_histogram(recs);
+  print_access_pattern(recs);
+  print_timeline(recs, opts.bins);
+  if (!opts.timeline_csv.empty()) {
+    write_timeline_csv(recs, opts.timeline_csv);
+  }
+  return 0;
+} catch (...) {
+
+  return exception_handler();
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <argparse/argparse.hpp>
+#include <fmt/format.h>
+#include <filesystem>
+
+struct merge_options
+{
+    std::filesystem::path trace_dir;
+    std::filesystem::path timeline_csv;
+    int bins{40};
+};
+
+inline merge_options parser(int argc, char **argv)
+{
+    argparse::ArgumentParser program("Merge per-rank I/O traces");
+    program.add_argument("trace_dir")
+        .help("Directory containing the io_trace.<rank>.bin files")
+        .required();
+    program.add_argument("--timeline")
+        .help("Write every record, sorted by start time, to this CSV file")
+        .default_value(std::string{});
+    program.add_argument("--bins")
+        .help("Number of time bins of the text timeline")
+        .default_value(40)
+        .scan<'i', int>();
+    program.parse_args(argc, argv);
+
+    merge_options opts;
+    opts.trace_dir = std::filesystem::path(program.get<std::string>("trace_dir"));
+    opts.timeline_csv = std::filesystem::path(program.get<std::string>("--timeline"));
+    opts.bins = program.get<int>("--bins");
+    if (!std::filesystem::is_directory(opts.trace_dir))
+    {
+        auto str = fmt::format("Trace directory: {} does not exist or is not a directory\n", opts.trace_dir.string());
+        throw std::runtime_error(str);
+    }
+    if (opts.bins < 1)
+    {
+        throw std::runtime_error("--bins must be >= 1\n");
+    }
+    return opts;
+}
@@ -0,0 +1,368 @@
+#include "main.hpp"
+#include <fmt/format.h>
+#include <mpicpp.hpp>
+#include "content_hash.hpp"
+#include "fixed_point.hpp"
+#include "general_utils.hpp"
+#include "hdf5_utils.hpp"
+#include "io_trace_pmpi.hpp"
+#include "mpi_helpers.hpp"
+#include "snap_io.hpp"
+#include "unit_conversion.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <functional>
+#include <map>
+#include <numeric>
+#include <string>
+#include <vector>
+
+// One attribute, independent of how it is stored: floats as doubles, integers as 64-bit
+// values, strings as their text up to the first NUL, anything else as native bytes.
+struct attr_value {
+  bool floating{false};
+  std::vector<double> num{};
+  std::vector<std::string> text{};
+};
+
+using attr_map = std::map<std::string, attr_value>;
+
+inline attr_value read_attr_value(hid_t attr) {
+  attr_value v;
+  hid_t type   = H5Aget_type(attr);
+  hid_t space  = H5Aget_space(attr);
+  const auto n = static_cast<std::size_t>(H5Sget_simple_extent_npoints(space));
+  switch (H5Tget_class(type)) {
+    case H5T_FLOAT:
+      v.floating = true;
+      v.num.resize(n);
+      H5Aread(attr, H5T_NATIVE_DOUBLE, v.num.data());
+      break;
+    case H5T_INTEGER: {
+      std::vector<std::int64_t> ints(n);
+      H5Aread(attr, H5Tget_sign(type) == H5T_SGN_NONE ? H5T_NATIVE_UINT64 : H5T_NATIVE_INT64,
+              ints.data());
+      for (auto i : ints)
+        v.text.push_back(std::to_string(i));
+      break;
+    }
+    case H5T_STRING:
+      if (H5Tis_variable_str(type) > 0) {
+        std::vector<char *> ptrs(n);
+        hid_t mem = H5Tcopy(H5T_C_S1);
+        H5Tset_size(mem, H5T_VARIABLE);
+        H5Aread(attr, mem, ptrs.data());
+        for (auto p : ptrs)
+          v.text.emplace_back(p ? p : "");
+        H5Dvlen_reclaim(mem, space, H5P_DEFAULT, ptrs.data());
+        H5Tclose(mem);
+      } else {
+        const std::size_t len = H5Tget_size(type);
+        std::string buf(n * len, '\0');
+        H5Aread(attr, type, buf.data());
+        for (std::size_t i = 0; i < n; ++i) {
+          auto s = buf.substr(i * len, len);
+          s.resize(std::strlen(s.c_str()));
+          v.text.push_back(s);
+        }
+      }
+      break;
+    default: {
+      hid_t mem             = H5Tget_native_type(type, H5T_DIR_ASCEND);
+      const std::size_t len = H5Tget_size(mem);
+      std::string buf(n * len, '\0');
+      H5Aread(attr, mem, buf.data());
+      for (std::size_t i = 0; i < n; ++i)
+        v.text.push_back(buf.substr(i * len, len));
+      H5Tclose(mem);
+    }
+  }
+  H5Sclose(space);
+  H5Tclose(type);
+  return v;
+}
+
+inline attr_map read_attributes(const H5::H5Object &obj) {
+  attr_map attrs;
+  H5Aiterate2(
+    obj.getId(), H5_INDEX_NAME, H5_ITER_INC, nullptr,
+    [](hid_t loc, const char *name, const H5A_info_t *, void *op) -> herr_t {
+      hid_t attr = H5Aopen(loc, name, H5P_DEFAULT);
+      (*static_cast<attr_map *>(op))[name] = read_attr_value(attr);
+      H5Aclose(attr);
+      return 0;
+    },
+    &attrs);
+  return attrs;
+}
+
+// differences of `cand` against `ref`, floats within `rtol` of each other are equal
+inline std::vector<std::string> compare_attributes(const attr_map &ref, const attr_map &cand,
+                                                   double rtol) {
+  std::vector<std::string> issues;
+  for (auto const &[name, r] : ref) {
+    // how the rows are stored, they are compared decoded
+    if (name == fixed_point_attribute)
+      continue;
+    auto it = cand.find(name);
+    if (it == cand.end()) {
+      issues.push_back(fmt::format("attribute {} missing", name));
+      continue;
+    }
+    auto const &c = it->second;
+    bool same     = r.floating == c.floating && r.num.size() == c.num.size() && r.text == c.text;
+    for (std::size_t i = 0; same && i < r.num.size(); ++i) {
+      const double a = r.num[i], b = c.num[i];
+      same = a == b || (std::isnan(a) && std::isnan(b)) ||
+             std::abs(a - b) <= rtol * std::max(std::abs(a), std::abs(b));
+    }
+    if (!same) {
+      issues.push_back(fmt::format("attribute {}: {}{} != {}{}", name, r.num, r.text, c.num,
+                                   c.text));
+    }
+  }
+  for (auto const &[name, c] : cand) {
+    // bookkeeping of test_* --resume and the --fixed-point-coords encoding
+    if (name == "source_fingerprint" || name == "content_hash" || name == fixed_point_attribute)
+      continue;
+    if (!ref.count(name))
+      issues.push_back(fmt::format("attribute {} unexpected", name));
+  }
+  return issues;
+}
+
+// one line of the report, only filled on island rank 0
+struct report_row {
+  int file;
+  std::string object;
+  std::string status;
+  std::string detail;
+
+  std::string csv() const {
+    auto quoted = detail;
+    std::replace(quoted.begin(), quoted.end(), '"', '\'');
+    return fmt::format("{},{},{},\"{}\"\n", file, object, status, quoted);
+  }
+};
+
+struct verify_totals {
+  std::uint64_t bytes{0};
+  std::uint64_t datasets{0};
+  std::uint64_t failed{0};
+};
+
+inline void add_row(std::vector<report_row> &rows, verify_totals &totals, int file,
+                    const std::string &object, const std::string &status,
+                    const std::vector<std::string> &issues = {}) {
+  if (status != "PASS")
+    ++totals.failed;
+  rows.push_back({file, object, status, fmt::format("{}", fmt::join(issues, "; "))});
+}
+
+// attributes of the group itself, compared on island rank 0
+inline void verify_group_attributes(const H5::H5File &ref, const H5::H5File &cand,
+                                    const std::string &group, int file,
+                                    const verify_options &opts, std::vector<report_row> &rows,
+                                    verify_totals &totals) {
+  if (!ref.nameExists(group))
+    return;
+  if (!cand.nameExists(group)) {
+    add_row(rows, totals, file, group, "MISSING");
+    return;
+  }
+  auto issues = compare_attributes(read_attributes(ref.openGroup(group)),
+                                   read_attributes(cand.openGroup(group)), opts.rtol);
+  add_row(rows, totals, file, group, issues.empty() ? "PASS" : "DIFF", issues);
+}
+
+// Collective over the island. One dataset at a time is read from either file with the
+// parallel reader and reduced to a partition-independent hash, so each rank only holds its
+// slab of a single dataset.
+template <typename PT>
+void verify_parttype(const H5::H5File &ref, const H5::H5File &cand, const mpi_state &state,
+                     const header_group &header, const verify_options &opts,
+                     std::vector<report_row> &rows, verify_totals &totals) {
+  const std::string group = PT::group_name();
+  const bool root         = state.i_rank == 0;
+  if (!ref.nameExists(group))
+    return;
+  if (!cand.nameExists(group)) {
+    if (root)
+      add_row(rows, totals, state.i_file, group, "MISSING");
+    return;
+  }
+  auto ref_group  = ref.openGroup(group);
+  auto cand_group = cand.openGroup(group);
+  PT pt;
+  pt.for_each_dataset_all([&](auto &ds) {
+    using VT                 = typename std::decay_t<decltype(ds.data_chunk)>::value_type;
+    const std::string object = group + "/" + ds.name;
+    if (!ref_group.nameExists(ds.name))
+      return;
+    if (root)
+      ++totals.datasets;
+    if (!cand_group.nameExists(ds.name)) {
+      if (root)
+        add_row(rows, totals, state.i_file, object, "MISSING");
+      return;
+    }
+    ds.read_dataset_parallel(ref_group, ds.name, state.island_comm);
+    if constexpr (std::is_floating_point_v<VT>) {
+      // a --fixed-point-coords candidate is compared against the reference rounded the same way
+      auto cand_ds = cand_group.openDataSet(ds.name);
+      if (cand_ds.attrExists(fixed_point_attribute)) {
+        double scale = 0.0;
+        read_attribute(cand_ds, fixed_point_attribute, scale);
+        auto &rows   = ds.data_chunk;
+        const auto q = encode_fixed_point(rows.data(), rows.size(), scale * fixed_point_steps);
+        std::copy(q.begin(), q.end(), rows.begin());
+        decode_fixed_point(rows.data(), rows.size(), scale);
+      }
+    }
+    // a --physical-cgs candidate is compared against the reference converted the same way,
+    // which also turns the reference unit attributes into the ones the conversion writes
+    bool physical = false;
+    if constexpr (std::is_base_of_v<dataset_attributes, std::decay_t<decltype(ds)>>) {
+      if (cand_group.openDataSet(ds.name).attrExists(unit_system_attribute)) {
+        ds.physical_a = header.hb.Time;
+        ds.physical_h = header.hb.HubbleParam;
+        ds.convert_units(state.island_comm);
+        ds.physical_a = 0.0;
+        physical      = ds.units == unit_system::physical_cgs;
+      }
+    }
+    attr_map ref_attrs;
+    if (root) {
+      ref_attrs = read_attributes(ref_group.openDataSet(ds.name));
+      if constexpr (std::is_base_of_v<dataset_attributes, std::decay_t<decltype(ds)>>) {
+        if (physical) {
+          auto converted = [&](const char *attr, double value) {
+            if (ref_attrs.count(attr))
+              ref_attrs[attr].num = {value};
+          };
+          converted("a_scaling", ds.a_scaling);
+          converted("h_scaling", ds.h_scaling);
+          converted("to_cgs", ds.to_cgs);
+          ref_attrs[unit_system_attribute] = {false, {}, {unit_system_name(ds.units)}};
+        }
+      }
+    }
+    ds.hash_rows(state.island_comm, !opts.unordered);
+    const auto ref_dims = ds.total_dataspace_dims;
+    const auto ref_hash = ds.hash;
+    ds.read_dataset_parallel(cand_group, ds.name, state.island_comm);
+    ds.hash_rows(state.island_comm, !opts.unordered);
+    std::vector<VT>().swap(ds.data_chunk);
+    if (!root)
+      return;
+    totals.bytes += 2 * sizeof(VT) *
+                    std::accumulate(ref_dims.begin(), ref_dims.end(), std::uint64_t{1},
+                                    std::multiplies<std::uint64_t>());
+    std::vector<std::string> issues;
+    if (ref_dims != ds.total_dataspace_dims)
+      issues.push_back(fmt::format("dims {} != {}", ref_dims, ds.total_dataspace_dims));
+    else if (ref_hash != ds.hash)
+      issues.push_back(fmt::format("content hash {:#018x} != {:#018x}", ref_hash, ds.hash));
+    auto attr_issues = compare_attributes(ref_attrs,
+                                          read_attributes(cand_group.openDataSet(ds.name)),
+                                          opts.rtol);
+    issues.insert(issues.end(), attr_issues.begin(), attr_issues.end());
+    add_row(rows, totals, state.i_file, object, issues.empty() ? "PASS" : "DIFF", issues);
+  });
+}
+
+void verify_file(const mpi_state &state, const verify_options &opts,
+                 const H5::FileAccPropList &fapl, std::vector<report_row> &rows,
+                 verify_totals &totals) {
+  if (!std::filesystem::exists(snap_file_path(opts.candidate_dir, state.i_file))) {
+    if (state.i_rank == 0)
+      add_row(rows, totals, state.i_file, "/", "MISSING");
+    return;
+  }
+  auto ref  = create_parallel_file_handle(opts.reference_dir, state, H5F_ACC_RDONLY, fapl);
+  auto cand = create_parallel_file_handle(opts.candidate_dir, state, H5F_ACC_RDONLY, fapl);
+
+  if (state.i_rank == 0) {
+    for (const char *group : {"/Header", "/Config", "/Parameters"})
+      verify_group_attributes(ref, cand, group, state.i_file, opts, rows, totals);
+  }
+
+  // the PartTypes to compare are the ones the reference header announces
+  header_group header;
+  header.read_from_file_parallel(ref);
+  const auto &npart = header.hb.NumPart_Total;
+  if (npart[0] > 0)
+    verify_parttype<PartType0>(ref, cand, state, header, opts, rows, totals);
+  if (npart[1] > 0)
+    verify_parttype<PartType1>(ref, cand, state, header, opts, rows, totals);
+  if (npart[3] > 0)
+    verify_parttype<PartType3>(ref, cand, state, header, opts, rows, totals);
+  if (npart[4] > 0)
+    verify_parttype<PartType4>(ref, cand, state, header, opts, rows, totals);
+  if (npart[5] > 0)
+    verify_parttype<PartType5>(ref, cand, state, header, opts, rows, totals);
+}
+
+int main(int argc, char **argv) try {
+  H5::Exception::dontPrint();
+  auto opts    = parser(argc, argv);
+  int numfiles = count_hdf5_files(opts.reference_dir);
+  mpicpp::environment env(&argc, &argv);
+  mpi_state state(numfiles);
+
+  const double t0 = MPI_Wtime();
+  // built once, every file of the island's queue is opened with it
+  const auto fapl = create_mpi_fapl(state.island_comm);
+  std::vector<report_row> rows;
+  verify_totals totals;
+  for (int f : state.files) {
+    state.i_file = f;
+    verify_file(state, opts, fapl, rows, totals);
+  }
+  const double elapsed = MPI_Wtime() - t0;
+
+  // island roots hold the rows, world rank 0 prints them ordered by file
+  std::string mine;
+  for (auto const &row : rows) {
+    if (!opts.failures_only || row.status != "PASS")
+      mine += row.csv();
+  }
+  int len = static_cast<int>(mine.size());
+  std::vector<int> lens(state.w_rank == 0 ? state.w_size : 0);
+  MPI_Gather(&len, 1, MPI_INT, lens.data(), 1, MPI_INT, 0, state.world_comm.get());
+  std::vector<int> displs(lens.size(), 0);
+  for (std::size_t r = 1; r < lens.size(); ++r)
+    displs[r] = displs[r - 1] + lens[r - 1];
+  std::string all(lens.empty() ? 0 : displs.back() + lens.back(), '\0');
+  MPI_Gatherv(mine.data(), len, MPI_CHAR, all.data(), lens.data(), displs.data(), MPI_CHAR, 0,
+              state.world_comm.get());
+
+  std::uint64_t local[3] = {totals.bytes, totals.datasets, totals.failed};
+  std::uint64_t sums[3];
+  MPI_Allreduce(local, sums, 3, MPI_UINT64_T, MPI_SUM, state.world_comm.get());
+  double slowest = 0.0;
+  MPI_Reduce(&elapsed, &slowest, 1, MPI_DOUBLE, MPI_MAX, 0, state.world_comm.get());
+
+  if (state.w_rank == 0) {
+    std::vector<std::string> lines;
+    for (std::size_t pos = 0, end; pos < all.size(); pos = end + 1) {
+      end = all.find('\n', pos);
+      lines.push_back(all.substr(pos, end - pos));
+    }
+    std::stable_sort(lines.begin(), lines.end(), [](auto const &a, auto const &b) {
+      return std::stoi(a) < std::stoi(b);
+    });
+    fmt::print("file,object,status,detail\n");
+    for (auto const &line : lines)
+      fmt::print("{}\n", line);
+    fmt::print("# {} files, {} particle datasets, {:.3f} GiB read in {:.3f} s, {} failed: {}\n",
+               numfiles, sums[1], sums[0] / double(1 << 30), slowest, sums[2],
+               sums[2] == 0 ? "PASS" : "FAIL");
+  }
+  return sums[2] == 0 ? 0 : 1;
+} catch (...) {
+
+  return exception_handler();
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <argparse/argparse.hpp>
+#include <fmt/format.h>
+#include <filesystem>
+
+struct verify_options
+{
+    std::filesystem::path reference_dir;
+    std::filesystem::path candidate_dir;
+    double rtol{0.0};
+    bool unordered{false};
+    bool failures_only{false};
+};
+
+inline verify_options parser(int argc, char **argv)
+{
+    argparse::ArgumentParser program("Parallel snapshot verification");
+    program.add_argument("reference_dir")
+        .help("Directory with the reference snap_099.N.hdf5 files, e.g. the input of a copy")
+        .required();
+    program.add_argument("candidate_dir")
+        .help("Directory with the snap_099.N.hdf5 files to check, e.g. <dir>/out_test_sread_swrite")
+        .required();
+    program.add_argument("--rtol")
+        .help("Relative tolerance for floating-point attributes, 0 compares exactly")
+        .default_value(0.0)
+        .scan<'g', double>();
+    program.add_argument("--unordered")
+        .help("Compare particle datasets as sets of rows, e.g. against a --ph-sort copy")
+        .flag();
+    program.add_argument("--failures-only")
+        .help("Only report objects that differ or are missing")
+        .flag();
+    program.parse_args(argc, argv);
+
+    verify_options opts;
+    opts.reference_dir = std::filesystem::path(program.get<std::string>("reference_dir"));
+    opts.candidate_dir = std::filesystem::path(program.get<std::string>("candidate_dir"));
+    opts.rtol = program.get<double>("--rtol");
+    opts.unordered = program.get<bool>("--unordered");
+    opts.failures_only = program.get<bool>("--failures-only");
+    for (const auto &dir : {opts.reference_dir, opts.candidate_dir})
+    {
+        if (!std::filesystem::exists(dir) || !std::filesystem::is_directory(dir))
+        {
+            auto str = fmt::format("Input directory: {} does not exist or is not a directory\n", dir.string());
+            throw std::runtime_error(str);
+        }
+    }
+    if (opts.rtol < 0.0)
+    {
+        throw std::runtime_error("--rtol must be >= 0\n");
+    }
+    return opts;
+}
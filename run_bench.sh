@@ -14,7 +14,7 @@ module load CMake
 
 # --- Arguments ---
 if [ $# -ne 3 ]; then
-    echo "Usage: sbatch $0 <input_dir> <num_runs> <output_csv>"
+    echo "Usage: sbatch $0 <input_dir> <num_repetitions> <output_csv>"
     exit 1
 fi
 
@@ -34,17 +34,18 @@ echo "Max cores on this node: $MAX_CORES"
 
 # --- Prepare output ---
 mkdir -p "$(dirname "$CSV_FILE")"
-echo "#nranks,run,minranksperisland,read,scatter,write" > "$CSV_FILE"
+: > "$CSV_FILE"
 
 # --- Loop over multiples of count ---
 for ((ranks=$count; ranks<=MAX_CORES; ranks+=count)); do
     echo "▶️ Testing with $ranks ranks (multiple of numfiles($count))"
     
-    for i in $(seq 1 $NUM_RUNS); do
-        echo -n "   Run $i ..."
-        srun -N ${SLURM_NNODES} -n $ranks ./build/bin/final "$INPUT_DIR" \
-        | awk -v r=$ranks -v run=$i -F, '{print r","run","$0}' | tee -a "$CSV_FILE"
-    done
+    # repetitions run inside one job step, the benchmark reports median/IQR/CI per phase
+    srun -N ${SLURM_NNODES} -n $ranks ./build/bin/final "$INPUT_DIR" --format csv \
+        --repeat $NUM_RUNS --warmup 1 \
+    | awk -v has_header=$([ -s "$CSV_FILE" ] && echo 1 || echo 0) \
+        'NR==1 { if (!has_header) print; next } {print}' \
+    | tee -a "$CSV_FILE"
 done
 
 echo "✅ Benchmark finished. Results in $CSV_FILE"
@@ -28,8 +28,8 @@ fi
 
 srun -N $SLURM_NNODES -n $((SLURM_NTASKS_PER_NODE * SLURM_NNODES)) "$EXE_NAME" "${DIR1}/"
 
-echo "Running hdf5diff.sh to compare input and output files..."
+echo "Running snap_verify to compare input and output files..."
 
-./hdf5diff.sh "${DIR1}" "${DIR2}"
+srun -N $SLURM_NNODES -n $((SLURM_NTASKS_PER_NODE * SLURM_NNODES)) "$(dirname "$EXE_NAME")/snap_verify" "${DIR1}/" "${DIR2}/" --failures-only
 
 echo "Comparison complete."
\ No newline at end of file